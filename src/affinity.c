@@ -0,0 +1,288 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "affinity.h"
+#include "log.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define AFFINITY_NODES_MAX 1024
+
+int affinity_parse(const char *list, CpuList_t *cpus)
+{
+    const char *current = list;
+
+    cpus->count = 0;
+    while (*current)
+    {
+        char *end = NULL;
+        long first, last;
+
+        while (*current == ' ' || *current == '\n')
+        {
+            current++;
+        }
+        if (!*current)
+        {
+            break;
+        }
+
+        first = strtol(current, &end, 10);
+        if (end == current || first < 0)
+        {
+            return 0;
+        }
+        last = first;
+        current = end;
+
+        if (*current == '-')
+        {
+            current++;
+            last = strtol(current, &end, 10);
+            if (end == current || last < first)
+            {
+                return 0;
+            }
+            current = end;
+        }
+
+        if (last >= CPU_SETSIZE || cpus->count + (size_t) (last - first + 1) > AFFINITY_CPUS_MAX)
+        {
+            return 0;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            cpus->cpus[cpus->count++] = (uint16_t) cpu;
+        }
+
+        while (*current == ' ' || *current == '\n')
+        {
+            current++;
+        }
+        if (*current == ',')
+        {
+            current++;
+        }
+        else if (*current)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void affinity_pin(pthread_t thread, const CpuList_t *cpus, size_t index)
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (!cpus || !cpus->count)
+    {
+        return;
+    }
+
+    cpu = cpus->cpus[index % cpus->count];
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thread, sizeof(set), &set))
+    {
+        log_warning("Unable to pin a thread to the CPU %d", cpu);
+    }
+}
+
+/*
+ * Read a list of /sys, like the CPUs of a node
+ */
+static int read_list(const char *path, CpuList_t *list)
+{
+    char line[4096];
+    FILE *file = fopen(path, "r");
+    int read = 0;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    read = fgets(line, sizeof(line), file) && affinity_parse(line, list);
+    fclose(file);
+
+    return read;
+}
+
+int affinity_nodes(void)
+{
+    CpuList_t nodes;
+    int count = 1;
+
+    if (!read_list("/sys/devices/system/node/online", &nodes))
+    {
+        return 1;
+    }
+
+    for (size_t i = 0; i < nodes.count; i++)
+    {
+        count = nodes.cpus[i] + 1 > count ? nodes.cpus[i] + 1 : count;
+    }
+
+    return count > AFFINITY_NODES_MAX ? AFFINITY_NODES_MAX : count;
+}
+
+int affinity_current_node(void)
+{
+    unsigned int cpu = 0, node = 0;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL))
+    {
+        return 0;
+    }
+
+    return (int) node;
+}
+
+typedef struct
+{
+    const PointArray_t *points;
+    int node;
+    PointArray_t *replica;
+} Replication_t;
+
+/*
+ * On a CPU of the node, the pages are placed by the first touch when the
+ * memory policy cannot be set
+ */
+static void *copy_points(void *data)
+{
+    Replication_t *replication = (Replication_t *) data;
+    const PointArray_t *points = replication->points;
+    size_t records = points->length * sizeof(Point_t);
+    size_t size = records + points->length * sizeof(Point_t *);
+    unsigned long mask[AFFINITY_NODES_MAX / (8 * sizeof(unsigned long))];
+    PointArray_t *replica = replication->replica;
+    char *memory = NULL;
+    Point_t *copies = NULL;
+
+    if (!size)
+    {
+        return NULL;
+    }
+
+    memory = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        log_critical("Unable to allocate the points of the NUMA node %d", replication->node);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(mask, 0, sizeof(mask));
+    mask[replication->node / (8 * sizeof(unsigned long))] |= 1UL << (replication->node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, memory, size, MPOL_PREFERRED, mask, AFFINITY_NODES_MAX, 0))
+    {
+        log_debug("Unable to bind the points to the NUMA node %d: %s", replication->node, strerror(errno));
+    }
+
+    copies = (Point_t *) memory;
+    replica->points = (Point_t **) (memory + records);
+    for (size_t i = 0; i < points->length; i++)
+    {
+        copies[i] = *points->points[i];
+        replica->points[i] = &copies[i];
+    }
+
+    return NULL;
+}
+
+PointArray_t *affinity_replicate(const PointArray_t *points, int node)
+{
+    Replication_t replication = {points, node, NULL};
+    char path[128];
+    CpuList_t cpus;
+    cpu_set_t set;
+    pthread_attr_t attributes;
+    pthread_t thread;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if (!read_list(path, &cpus) || !cpus.count)
+    {
+        return NULL;
+    }
+
+    replication.replica = points_array_create(0);
+    replication.replica->length = points->length;
+    replication.replica->position = points->position;
+
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.count; i++)
+    {
+        CPU_SET(cpus.cpus[i], &set);
+    }
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setaffinity_np(&attributes, sizeof(set), &set);
+    if (pthread_create(&thread, &attributes, copy_points, &replication))
+    {
+        log_critical("Unable to start the copy of the points for the NUMA node %d", node);
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attributes);
+
+    log_info("Copied %zu points on the NUMA node %d", points->length, node);
+
+    return replication.replica;
+}
+
+void affinity_replica_dispose(PointArray_t *replica)
+{
+    if (!replica)
+    {
+        return;
+    }
+
+    if (replica->points)
+    {
+        munmap((char *) replica->points - replica->length * sizeof(Point_t),
+               replica->length * (sizeof(Point_t) + sizeof(Point_t *)));
+    }
+    free(replica);
+}
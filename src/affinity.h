@@ -0,0 +1,102 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include "points_array.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AFFINITY_CPUS_MAX 1024
+
+/*
+ * CPUs in the order of a list like 0-3,8-11
+ */
+typedef struct
+{
+    uint16_t cpus[AFFINITY_CPUS_MAX];
+    size_t count;
+} CpuList_t;
+
+/*
+ * Read a CPU list
+ *
+ * @param list: The CPUs, ranges separated by commas (0-3,8,10-11)
+ * @param cpus: The list to fill, empty for an empty string
+ * @return 0 if the list is malformed
+ */
+int affinity_parse(const char *list, CpuList_t *cpus);
+
+/*
+ * Pin a thread to one CPU of a list, the threads take them in turn
+ *
+ * @param thread: The thread
+ * @param cpus: The CPUs, nothing is done when empty
+ * @param index: The rank of the thread, modulo the count of CPUs
+ */
+void affinity_pin(pthread_t thread, const CpuList_t *cpus, size_t index);
+
+/*
+ * Count the NUMA nodes, from /sys/devices/system/node/online
+ *
+ * @return The highest node plus one, 1 without NUMA
+ */
+int affinity_nodes(void);
+
+/*
+ * The NUMA node of the CPU running the calling thread
+ *
+ * @return The node, 0 when unknown
+ */
+int affinity_current_node(void);
+
+/*
+ * Copy the points in the memory of a NUMA node, for the threads running on
+ * it. The descriptions are shared with the original.
+ *
+ * @param points: The points
+ * @param node: The NUMA node
+ * @return The copy, or NULL when the node has no CPU or memory
+ */
+PointArray_t *affinity_replicate(const PointArray_t *points, int node);
+
+/*
+ * Free a copy of affinity_replicate
+ *
+ * @param replica: The copy, can be NULL
+ */
+void affinity_replica_dispose(PointArray_t *replica);
+
+#endif
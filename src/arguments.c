@@ -51,6 +51,8 @@ Argument_t *argument_create(void)
     }
 
     args->help = 0;
+    args->publish = 0;
+    args->workers = 0;
     args->filename = NULL;
     args->config_file = NULL;
 
@@ -68,7 +70,7 @@ Argument_t *argument_check(int argc, char **argv)
 {
     Argument_t *args;
     int i;
-    uint8_t expect_file = 0, expected_config = 0;
+    uint8_t expect_file = 0, expected_config = 0, expected_workers = 0;
 
     args = argument_create();
 
@@ -88,12 +90,30 @@ Argument_t *argument_check(int argc, char **argv)
             continue;
         }
 
+        if (expected_workers)
+        {
+            args->workers = atoi(argv[i]);
+            if (args->workers <= 0)
+            {
+                log_critical("The number of workers must be positive, not %s", argv[i]);
+                exit(1);
+            }
+            expected_workers = 0;
+            continue;
+        }
+
         if (!strcmp("-h", argv[i]) || !strcmp("--help", argv[i]))
         {
             args->help = 1;
             continue;
         }
 
+        if (!strcmp("-p", argv[i]) || !strcmp("--publish", argv[i]))
+        {
+            args->publish = 1;
+            continue;
+        }
+
         if (!strcmp("-f", argv[i]) || !strcmp("--file", argv[i]))
         {
             expect_file = 1;
@@ -106,6 +126,12 @@ Argument_t *argument_check(int argc, char **argv)
             continue;
         }
 
+        if (!strcmp("-w", argv[i]) || !strcmp("--workers", argv[i]))
+        {
+            expected_workers = 1;
+            continue;
+        }
+
         log_critical("Unknown arguments %s\n", argv[i]);
         exit(1);
     }
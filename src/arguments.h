@@ -37,6 +37,8 @@
 typedef struct
 {
     uint8_t help;
+    uint8_t publish;
+    int workers;
     char *filename;
     char *config_file;
 } Argument_t;
@@ -0,0 +1,189 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "body.h"
+#include "log.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BODY_READ_CHUNK 65536
+
+/*
+ * Write the content in an unlinked file of the directory
+ *
+ * @return The file descriptor, -1 on failure
+ */
+static int write_file(struct evbuffer *content, const char *directory)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/geocluster-body-XXXXXX", directory);
+    fd = mkstemp(path);
+    if (fd == -1)
+    {
+        log_warning("Unable to create a body file in %s: %s", directory, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+
+    while (evbuffer_get_length(content))
+    {
+        if (evbuffer_write(content, fd) == -1 && errno != EINTR)
+        {
+            log_warning("Unable to write a body file in %s: %s", directory, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+Body_t *body_create(struct evbuffer *content, const char *directory)
+{
+    size_t length = evbuffer_get_length(content);
+    int fd = -1;
+    Body_t *body = NULL;
+
+    if (directory)
+    {
+        struct evbuffer *copy = evbuffer_new();
+
+        /* Keep the content if the file can't be written */
+        evbuffer_add_buffer_reference(copy, content);
+        fd = write_file(copy, directory);
+        evbuffer_free(copy);
+    }
+
+    body = (Body_t *) malloc(sizeof(Body_t) + (fd == -1 ? length : 0));
+    if (!body)
+    {
+        log_critical("Unable to allocate a body of %zu bytes", length);
+        exit(EXIT_FAILURE);
+    }
+
+    body->length = length;
+    body->references = 1;
+    body->segment = NULL;
+    body->fd = fd;
+
+    if (fd == -1)
+    {
+        evbuffer_remove(content, body->data, length);
+        return body;
+    }
+
+    evbuffer_drain(content, length);
+    body->segment = evbuffer_file_segment_new(fd, 0, (ev_off_t) length, EVBUF_FS_CLOSE_ON_FREE);
+    if (!body->segment)
+    {
+        log_critical("Unable to create a file segment of %zu bytes", length);
+        exit(EXIT_FAILURE);
+    }
+
+    return body;
+}
+
+Body_t *body_retain(Body_t *body)
+{
+    __atomic_add_fetch(&body->references, 1, __ATOMIC_RELAXED);
+    return body;
+}
+
+void body_release(Body_t *body)
+{
+    if (!body || __atomic_sub_fetch(&body->references, 1, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    if (body->segment)
+    {
+        /* The buffers still sending the file have their own reference on the segment, the last closes it */
+        evbuffer_file_segment_free(body->segment);
+    }
+    free(body);
+}
+
+static void on_reference_done(const void *data, size_t length, void *arg)
+{
+    (void) data;
+    (void) length;
+
+    body_release((Body_t *) arg);
+}
+
+void body_add_to(Body_t *body, struct evbuffer *output)
+{
+    if (body->segment)
+    {
+        evbuffer_add_file_segment(output, body->segment, 0, (ev_off_t) body->length);
+        return;
+    }
+
+    evbuffer_add_reference(output, body->data, body->length, on_reference_done, body_retain(body));
+}
+
+void body_copy_to(Body_t *body, struct evbuffer *output)
+{
+    struct evbuffer_iovec space;
+    size_t offset = 0;
+
+    if (!body->segment)
+    {
+        evbuffer_add(output, body->data, body->length);
+        return;
+    }
+
+    while (offset < body->length)
+    {
+        size_t size = body->length - offset < BODY_READ_CHUNK ? body->length - offset : BODY_READ_CHUNK;
+        ssize_t got;
+
+        evbuffer_reserve_space(output, (ev_ssize_t) size, &space, 1);
+        got = pread(body->fd, space.iov_base, size, (off_t) offset);
+        if (got <= 0)
+        {
+            log_critical("Unable to read a body file: %s", got ? strerror(errno) : "truncated");
+            exit(EXIT_FAILURE);
+        }
+
+        space.iov_len = (size_t) got;
+        evbuffer_commit_space(output, &space, 1);
+        offset += (size_t) got;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BODY_H__
+#define __BODY_H__
+
+#include <event2/buffer.h>
+#include <stddef.h>
+
+/*
+ * An immutable response body, shared by reference between the cache and the
+ * responses being sent. It lives in memory, or in an unlinked file sent with
+ * sendfile.
+ */
+typedef struct Body_t
+{
+    size_t length;
+    int references;
+    struct evbuffer_file_segment *segment;
+    int fd;
+    char data[];
+} Body_t;
+
+/*
+ * Move the content of a buffer into a new body, with one reference. The bytes
+ * are copied once, there.
+ *
+ * @param content: The buffer, emptied
+ * @param directory: Store the body in a file of this directory, NULL to keep it in memory
+ * @return The body
+ */
+Body_t *body_create(struct evbuffer *content, const char *directory);
+
+/*
+ * Take a reference on a body
+ *
+ * @param body: The body
+ * @return The body
+ */
+Body_t *body_retain(Body_t *body);
+
+/*
+ * Drop a reference on a body, freed with the last one
+ *
+ * @param body: The body, may be NULL
+ */
+void body_release(Body_t *body);
+
+/*
+ * Append a body to an output buffer without copying it. The buffer holds a
+ * reference until libevent has sent the bytes.
+ *
+ * @param body: The body
+ * @param output: The buffer to append to
+ */
+void body_add_to(Body_t *body, struct evbuffer *output);
+
+/*
+ * Append a copy of a body to a buffer, for the code reading the bytes
+ * (a file body isn't mapped in memory).
+ *
+ * @param body: The body
+ * @param output: The buffer to append to
+ */
+void body_copy_to(Body_t *body, struct evbuffer *output);
+
+#endif
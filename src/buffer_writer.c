@@ -0,0 +1,81 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "buffer_writer.h"
+#include "log.h"
+
+#include <stdlib.h>
+
+#define BUFFER_WRITER_CHUNK 16384
+
+void buffer_writer_init(BufferWriter_t *writer, struct evbuffer *output)
+{
+    writer->output = output;
+    writer->space.iov_base = NULL;
+    writer->space.iov_len = 0;
+    writer->cursor = writer->end = NULL;
+}
+
+void buffer_writer_commit(BufferWriter_t *writer)
+{
+    if (!writer->space.iov_base)
+    {
+        return;
+    }
+
+    writer->space.iov_len = (size_t) (writer->cursor - (char *) writer->space.iov_base);
+    evbuffer_commit_space(writer->output, &writer->space, 1);
+    writer->space.iov_base = NULL;
+    writer->cursor = writer->end = NULL;
+}
+
+size_t buffer_writer_length(const BufferWriter_t *writer)
+{
+    size_t pending = writer->space.iov_base ? (size_t) (writer->cursor - (char *) writer->space.iov_base) : 0;
+
+    return evbuffer_get_length(writer->output) + pending;
+}
+
+void buffer_writer_grow(BufferWriter_t *writer, size_t size)
+{
+    buffer_writer_commit(writer);
+
+    if (evbuffer_reserve_space(writer->output,
+                               (ev_ssize_t) (size > BUFFER_WRITER_CHUNK ? size : BUFFER_WRITER_CHUNK),
+                               &writer->space, 1) != 1)
+    {
+        log_critical("Unable to reserve %zu bytes for the output", size);
+        exit(EXIT_FAILURE);
+    }
+
+    writer->cursor = writer->space.iov_base;
+    writer->end = writer->cursor + writer->space.iov_len;
+}
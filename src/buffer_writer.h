@@ -0,0 +1,85 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BUFFER_WRITER_H__
+#define __BUFFER_WRITER_H__
+
+#include <event2/buffer.h>
+#include <stddef.h>
+
+/*
+ * Write straight into the free space of an evbuffer: the space is reserved
+ * by chunks and committed when full, the encoders only move the cursor.
+ */
+typedef struct BufferWriter_t
+{
+    struct evbuffer *output;
+    struct evbuffer_iovec space;
+    char *cursor;
+    char *end;
+} BufferWriter_t;
+
+/*
+ * Start writing at the end of the output buffer
+ *
+ * @param writer: The writer to initialize
+ * @param output: The buffer to append to
+ */
+void buffer_writer_init(BufferWriter_t *writer, struct evbuffer *output);
+
+/*
+ * Commit the written bytes to the output buffer. The writer can be used
+ * again, it reserves a new space.
+ */
+void buffer_writer_commit(BufferWriter_t *writer);
+
+/*
+ * Get the length of the output buffer, with the bytes not committed yet
+ */
+size_t buffer_writer_length(const BufferWriter_t *writer);
+
+/*
+ * Commit and reserve a space of size bytes at least, use buffer_writer_reserve
+ */
+void buffer_writer_grow(BufferWriter_t *writer, size_t size);
+
+/*
+ * Make sure there's room for size bytes at the cursor
+ */
+static inline void buffer_writer_reserve(BufferWriter_t *writer, size_t size)
+{
+    if ((size_t) (writer->end - writer->cursor) < size)
+    {
+        buffer_writer_grow(writer, size);
+    }
+}
+
+#endif
@@ -72,20 +72,16 @@ static inline char cluster_contains(Cluster_t *cluster, Point_t *point) {
            point->position.lng <= cluster->east;
 }
 
-static void cluster_populate_groups(Cluster_t *cluster, double excluded_lat,
-                                    double excluded_lng) {
+static int cluster_populate_groups(Cluster_t *cluster) {
     register int length = (int) cluster->points_array->length;
 
     for (register int i = 0; i < cluster->height; i++) {
         for (register int j = 0; j < cluster->width; j++) {
-            for (register int p = 0; p < length; p++) {
-                if (cluster->points_array->points[p]->position.lat ==
-                    excluded_lat
-                    && cluster->points_array->points[p]->position.lng ==
-                       excluded_lng) {
-                    continue;
-                }
+            if (cluster->cancelled && cluster->cancelled(cluster->cancel_data)) {
+                return 0;
+            }
 
+            for (register int p = 0; p < length; p++) {
                 if (cluster_contains(cluster,
                                      cluster->points_array->points[p])) {
                     if (cluster->points_array->points[p]->disappeared) {
@@ -107,6 +103,8 @@ static void cluster_populate_groups(Cluster_t *cluster, double excluded_lat,
             }
         }
     }
+
+    return 1;
 }
 
 Cluster_t *
@@ -130,6 +128,8 @@ cluster_create(uint8_t width, uint8_t height, PointArray_t *points_array) {
     cluster->west = 0.;
     cluster->lat = 0.;
     cluster->lng = 0.;
+    cluster->cancelled = NULL;
+    cluster->cancel_data = NULL;
 
     return cluster;
 }
@@ -165,16 +165,24 @@ cluster_set_bounds(Cluster_t *cluster, double north, double south, double east,
     cluster->west = convert_lng_from_gps(west);
 }
 
-void
-cluster_compute(Cluster_t *cluster, double excluded_lat, double excluded_lng,
-                int clusterize) {
+void cluster_set_cancel(Cluster_t *cluster, ClusterCancel cancelled, void *data) {
+    cluster->cancelled = cancelled;
+    cluster->cancel_data = data;
+}
+
+int cluster_compute(Cluster_t *cluster, int clusterize) {
     log_info("Clusterize: %d", clusterize);
     log_info("Width: %d, Height: %d", cluster->width, cluster->height);
 
     cluster->groups_disappeared = cluster_create_sub_clusters(cluster);
     cluster->groups_exists = cluster_create_sub_clusters(cluster);
 
-    cluster_populate_groups(cluster, excluded_lat, excluded_lng);
+    if (!cluster_populate_groups(cluster)) {
+        log_info("Clustering cancelled");
+        return 0;
+    }
+
+    return 1;
 }
 
 void cluster_compute_barycenter(Cluster_t *cluster) {
@@ -189,3 +197,41 @@ void cluster_compute_barycenter(Cluster_t *cluster) {
     cluster->lat = s_lat / (double) cluster->points_array->length;
     cluster->lng = s_lng / (double) cluster->points_array->length;
 }
+
+ClusterCell_t *cluster_collect_cells(Cluster_t *root, Cluster_t ***grid, const Shift_t *shift, size_t *count) {
+    ClusterCell_t *cells = malloc(sizeof(ClusterCell_t) * ((size_t) root->width * root->height + 1));
+
+    if (!cells) {
+        log_critical("Memory error while collecting the cells");
+        exit(EXIT_FAILURE);
+    }
+
+    *count = 0;
+    for (register int i = 0; i < root->height; i++) {
+        for (register int j = 0; j < root->width; j++) {
+            Cluster_t *cell = grid[i][j];
+            ClusterCell_t *collected = &cells[*count];
+            size_t length = cell->points_array->length;
+
+            if (!length || (shift && delta_was_visible(shift, root->width, root->height, i, j))) {
+                continue;
+            }
+
+            collected->index = (uint32_t) (i * root->width + j);
+            collected->count = (uint32_t) length;
+            if (length == 1) {
+                collected->point = cell->points_array->points[0];
+                collected->lat = convert_lat_to_gps(collected->point->position.lat);
+                collected->lng = convert_lng_to_gps(collected->point->position.lng);
+            } else {
+                cluster_compute_barycenter(cell);
+                collected->point = NULL;
+                collected->lat = convert_lat_to_gps(cell->lat);
+                collected->lng = convert_lng_to_gps(cell->lng);
+            }
+            (*count)++;
+        }
+    }
+
+    return cells;
+}
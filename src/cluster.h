@@ -35,9 +35,13 @@
 #include "point.h"
 #include "points_array.h"
 #include "common.h"
+#include "delta.h"
 
 #include <stdint.h>
 
+/* Checked between the cells, non zero stops the computation */
+typedef int (*ClusterCancel)(void *data);
+
 typedef struct Cluster_t Cluster_t;
 struct Cluster_t
 {
@@ -47,12 +51,39 @@ struct Cluster_t
     PointArray_t *points_array;
     uint8_t width, height;
     double north, south, east, west, lat, lng;
+
+    ClusterCancel cancelled;
+    void *cancel_data;
 };
 
+/* A non empty cell of a grid, at its point or barycenter in GPS degrees */
+typedef struct ClusterCell_t
+{
+    uint32_t index;
+    uint32_t count;
+    double lat, lng;
+
+    /* The point of a cell of one, NULL otherwise */
+    const Point_t *point;
+} ClusterCell_t;
+
 Cluster_t *cluster_create(uint8_t width, uint8_t height, PointArray_t *points_array);
 void cluster_dispose(Cluster_t *cluster);
 void cluster_set_bounds(Cluster_t *cluster, double north, double south, double east, double west);
-void cluster_compute(Cluster_t *cluster, double excluded_lat, double excluded_lng, int clusterize);
+void cluster_set_cancel(Cluster_t *cluster, ClusterCancel cancelled, void *data);
+int cluster_compute(Cluster_t *cluster, int clusterize);
 void cluster_compute_barycenter(Cluster_t * cluster);
 
+/*
+ * Collect the non empty cells of a grid in row order, for the encoders
+ * writing them column by column.
+ *
+ * @param root: The clustering
+ * @param grid: Its groups_exists or groups_disappeared
+ * @param shift: Skip the cells the client has from before this shift, or NULL
+ * @param count: Where to store the number of cells
+ * @return The cells, to free
+ */
+ClusterCell_t *cluster_collect_cells(Cluster_t *root, Cluster_t ***grid, const Shift_t *shift, size_t *count);
+
 #endif
@@ -0,0 +1,193 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "compression.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#define COMPRESSION_CHUNK 16384
+
+/* zlib adds 16 to the window bits to write a gzip header */
+#define WINDOW_BITS 15
+#define GZIP_WINDOW_BITS (WINDOW_BITS + 16)
+#define MEMORY_LEVEL 8
+
+static const char *const Names[ENCODING_COUNT] = {"identity", "gzip", "deflate"};
+
+/*
+ * Read the quality of a coding in the parameters following it (;q=0.5)
+ */
+static double read_quality(const char *parameters, const char *end)
+{
+    const char *q = parameters;
+
+    while ((q = memchr(q, ';', (size_t) (end - q))))
+    {
+        q++;
+        q += strspn(q, " \t");
+        if ((*q == 'q' || *q == 'Q') && q[1] == '=')
+        {
+            return strtod(q + 2, NULL);
+        }
+    }
+
+    return 1.;
+}
+
+Encoding_t compression_negotiate(const char *accept_encoding)
+{
+    double qualities[ENCODING_COUNT] = {0., 0., 0.};
+    int listed[ENCODING_COUNT] = {0, 0, 0};
+    double any = 0.;
+    Encoding_t best = ENCODING_IDENTITY;
+
+    while (accept_encoding && *accept_encoding)
+    {
+        const char *end, *parameters;
+        size_t length;
+
+        accept_encoding += strspn(accept_encoding, " \t,");
+        end = accept_encoding + strcspn(accept_encoding, ",");
+        length = strcspn(accept_encoding, ",; \t");
+        parameters = accept_encoding + length;
+
+        if (length == 1 && *accept_encoding == '*')
+        {
+            any = read_quality(parameters, end);
+        }
+        for (int i = ENCODING_GZIP; i < ENCODING_COUNT; i++)
+        {
+            if (length == strlen(Names[i]) && !strncasecmp(accept_encoding, Names[i], length))
+            {
+                qualities[i] = read_quality(parameters, end);
+                listed[i] = 1;
+            }
+        }
+
+        accept_encoding = end;
+    }
+
+    for (int i = ENCODING_GZIP; i < ENCODING_COUNT; i++)
+    {
+        /* A coding that isn't listed gets the quality of * */
+        if (!listed[i])
+        {
+            qualities[i] = any;
+        }
+
+        if (qualities[i] > 0. && (best == ENCODING_IDENTITY || qualities[i] > qualities[best]))
+        {
+            best = (Encoding_t) i;
+        }
+    }
+
+    return best;
+}
+
+const char *compression_content_encoding(Encoding_t encoding)
+{
+    return encoding == ENCODING_IDENTITY ? NULL : Names[encoding];
+}
+
+/*
+ * Run deflate until it has consumed its input, or finished the stream
+ */
+static void deflate_into(z_stream *stream, int flush, struct evbuffer *output)
+{
+    struct evbuffer_iovec space;
+    int result;
+
+    do
+    {
+        if (evbuffer_reserve_space(output, COMPRESSION_CHUNK, &space, 1) != 1)
+        {
+            log_critical("Unable to reserve %d bytes for the compressed output", COMPRESSION_CHUNK);
+            exit(EXIT_FAILURE);
+        }
+
+        stream->next_out = space.iov_base;
+        stream->avail_out = (uInt) space.iov_len;
+        result = deflate(stream, flush);
+        if (result == Z_STREAM_ERROR)
+        {
+            log_critical("The compression failed: %s", stream->msg ? stream->msg : "stream error");
+            exit(EXIT_FAILURE);
+        }
+
+        space.iov_len -= stream->avail_out;
+        evbuffer_commit_space(output, &space, 1);
+    } while (stream->avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+}
+
+void compression_compress(struct evbuffer *input, Encoding_t encoding, int level, struct evbuffer *output)
+{
+    struct evbuffer_iovec *segments = NULL;
+    z_stream stream;
+    int count;
+
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, encoding == ENCODING_GZIP ? GZIP_WINDOW_BITS : WINDOW_BITS,
+                     MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        log_critical("Unable to initialize the compression");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Feed the segments of the buffer as they are, without making it contiguous */
+    count = evbuffer_peek(input, -1, NULL, NULL, 0);
+    if (count > 0)
+    {
+        segments = (struct evbuffer_iovec *) malloc(sizeof(struct evbuffer_iovec) * (size_t) count);
+        if (!segments)
+        {
+            log_critical("Unable to allocate the segments to compress");
+            exit(EXIT_FAILURE);
+        }
+        count = evbuffer_peek(input, -1, NULL, segments, count);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        stream.next_in = segments[i].iov_base;
+        stream.avail_in = (uInt) segments[i].iov_len;
+        deflate_into(&stream, Z_NO_FLUSH, output);
+    }
+
+    stream.next_in = NULL;
+    stream.avail_in = 0;
+    deflate_into(&stream, Z_FINISH, output);
+    deflateEnd(&stream);
+    free(segments);
+}
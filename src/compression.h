@@ -0,0 +1,73 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __COMPRESSION_H__
+#define __COMPRESSION_H__
+
+#include <event2/buffer.h>
+
+typedef enum Encoding_t
+{
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_DEFLATE,
+    ENCODING_COUNT,
+} Encoding_t;
+
+/*
+ * Choose the content coding from the Accept-Encoding header of a request, gzip
+ * is preferred to deflate when both have the same quality.
+ *
+ * @param accept_encoding: The header value, may be NULL
+ * @return The encoding, ENCODING_IDENTITY if nothing else is accepted
+ */
+Encoding_t compression_negotiate(const char *accept_encoding);
+
+/*
+ * Get the Content-Encoding header value of an encoding
+ *
+ * @param encoding: The encoding
+ * @return The header value, NULL for identity
+ */
+const char *compression_content_encoding(Encoding_t encoding);
+
+/*
+ * Compress a body segment by segment, straight into the free space of the output.
+ * The input isn't modified.
+ *
+ * @param input: The body to compress
+ * @param encoding: ENCODING_GZIP or ENCODING_DEFLATE (zlib format)
+ * @param level: The zlib level, 1 to 9
+ * @param output: The buffer to append to
+ */
+void compression_compress(struct evbuffer *input, Encoding_t encoding, int level, struct evbuffer *output);
+
+#endif
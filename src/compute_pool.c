@@ -0,0 +1,283 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "compute_pool.h"
+#include "log.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct ComputeTask_t
+{
+    ComputeCallback run;
+    ComputeCallback complete;
+    void *data;
+    struct event *done;
+};
+
+/* Bounded MPMC queue of Dmitry Vyukov */
+static int enqueue(ComputePool_t *pool, ComputeTask_t *task)
+{
+    size_t position = __atomic_load_n(&pool->enqueue_position, __ATOMIC_RELAXED);
+    ComputeSlot_t *slot = NULL;
+
+    for (;;)
+    {
+        slot = &pool->slots[position & pool->mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&pool->enqueue_position, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            return 0;
+        }
+        else
+        {
+            position = __atomic_load_n(&pool->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->task = task;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+static ComputeTask_t *dequeue(ComputePool_t *pool)
+{
+    size_t position = __atomic_load_n(&pool->dequeue_position, __ATOMIC_RELAXED);
+    ComputeSlot_t *slot = NULL;
+    ComputeTask_t *task = NULL;
+
+    for (;;)
+    {
+        slot = &pool->slots[position & pool->mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&pool->dequeue_position, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            position = __atomic_load_n(&pool->dequeue_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    task = slot->task;
+    __atomic_store_n(&slot->sequence, position + pool->mask + 1, __ATOMIC_RELEASE);
+
+    return task;
+}
+
+/*
+ * In the loop of the request
+ */
+static void on_task_done(evutil_socket_t fd, short what, void *arg)
+{
+    ComputeTask_t *task = (ComputeTask_t *) arg;
+
+    (void) fd;
+    (void) what;
+
+    task->complete(task->data);
+    event_free(task->done);
+    free(task);
+}
+
+static void *run_tasks(void *data)
+{
+    ComputePool_t *pool = (ComputePool_t *) data;
+    ComputeTask_t *task = NULL;
+
+    for (;;)
+    {
+        while (sem_wait(&pool->ready) && errno == EINTR)
+        {
+        }
+
+        /* One post per task, and one per thread to stop */
+        task = dequeue(pool);
+        if (!task)
+        {
+            if (__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE))
+            {
+                break;
+            }
+            continue;
+        }
+
+        task->run(task->data);
+        event_active(task->done, EV_TIMEOUT, 1);
+    }
+
+    return NULL;
+}
+
+ComputePool_t *compute_pool_create(int threads, size_t capacity)
+{
+    ComputePool_t *pool = NULL;
+    /* A slot of a queue of one would look free once filled */
+    size_t length = 2;
+
+    if (threads <= 0)
+    {
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads > 0 ? threads : 1;
+    }
+
+    while (length < capacity)
+    {
+        length <<= 1;
+    }
+
+    pool = (ComputePool_t *) calloc(1, sizeof(ComputePool_t));
+    if (!pool)
+    {
+        log_critical("Unable to allocate the compute pool");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->slots = (ComputeSlot_t *) calloc(length, sizeof(ComputeSlot_t));
+    pool->threads = (pthread_t *) calloc((size_t) threads, sizeof(pthread_t));
+    if (!pool->slots || !pool->threads)
+    {
+        log_critical("Unable to allocate the compute pool of %d threads", threads);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        pool->slots[i].sequence = i;
+    }
+    pool->mask = length - 1;
+    sem_init(&pool->ready, 0, 0);
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, run_tasks, pool))
+        {
+            log_critical("Unable to start the compute thread %d", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pool->threads_count = (size_t) threads;
+
+    log_info("Compute pool of %d threads, %zu tasks waiting at most", threads, length);
+
+    return pool;
+}
+
+void compute_pool_set_affinity(ComputePool_t *pool, const CpuList_t *cpus, size_t process)
+{
+    for (size_t i = 0; i < pool->threads_count; i++)
+    {
+        affinity_pin(pool->threads[i], cpus, process * pool->threads_count + i);
+    }
+}
+
+void compute_pool_dispose(ComputePool_t *pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    __atomic_store_n(&pool->stopping, 1, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < pool->threads_count; i++)
+    {
+        sem_post(&pool->ready);
+    }
+    for (size_t i = 0; i < pool->threads_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    sem_destroy(&pool->ready);
+    free(pool->threads);
+    free(pool->slots);
+    free(pool);
+}
+
+size_t compute_pool_pending(const ComputePool_t *pool)
+{
+    size_t dequeued = __atomic_load_n(&pool->dequeue_position, __ATOMIC_RELAXED);
+    size_t enqueued = __atomic_load_n(&pool->enqueue_position, __ATOMIC_RELAXED);
+
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+int compute_pool_submit(ComputePool_t *pool, struct event_base *base, ComputeCallback run, ComputeCallback complete,
+                        void *data)
+{
+    ComputeTask_t *task = (ComputeTask_t *) malloc(sizeof(ComputeTask_t));
+
+    if (!task)
+    {
+        log_critical("Unable to allocate a compute task");
+        exit(EXIT_FAILURE);
+    }
+
+    task->run = run;
+    task->complete = complete;
+    task->data = data;
+    task->done = event_new(base, -1, 0, on_task_done, task);
+
+    if (!enqueue(pool, task))
+    {
+        event_free(task->done);
+        free(task);
+        return 0;
+    }
+
+    sem_post(&pool->ready);
+
+    return 1;
+}
@@ -0,0 +1,120 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __COMPUTE_POOL_H__
+#define __COMPUTE_POOL_H__
+
+#include "affinity.h"
+
+#include <event2/event.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stddef.h>
+
+typedef void (*ComputeCallback)(void *data);
+
+typedef struct ComputeTask_t ComputeTask_t;
+
+/*
+ * A slot of the queue, its sequence tells if it is free for the producers
+ * or ready for the consumers
+ */
+typedef struct
+{
+    size_t sequence;
+    ComputeTask_t *task;
+} ComputeSlot_t;
+
+/*
+ * Threads running the heavy part of the requests. The tasks go through a
+ * bounded lock-free queue, many producers and many consumers, and their
+ * completion is run back in the event loop of the request.
+ */
+typedef struct
+{
+    ComputeSlot_t *slots;
+    size_t mask;
+    _Alignas(64) size_t enqueue_position;
+    _Alignas(64) size_t dequeue_position;
+    _Alignas(64) int stopping;
+    sem_t ready;
+    pthread_t *threads;
+    size_t threads_count;
+} ComputePool_t;
+
+/*
+ * Start the threads
+ *
+ * @param threads: The number of threads, 0 for one per CPU
+ * @param capacity: The tasks waiting at most, rounded up to a power of two, 2 at least
+ * @return The pool
+ */
+ComputePool_t *compute_pool_create(int threads, size_t capacity);
+
+/*
+ * Pin the threads, one CPU each
+ *
+ * @param pool: The pool
+ * @param cpus: The CPUs, taken in turn
+ * @param process: The rank of the process, its threads take the CPUs after those of the previous ones
+ */
+void compute_pool_set_affinity(ComputePool_t *pool, const CpuList_t *cpus, size_t process);
+
+/*
+ * Run the waiting tasks, then stop the threads and free the pool
+ *
+ * @param pool: The pool
+ */
+void compute_pool_dispose(ComputePool_t *pool);
+
+/*
+ * Count the tasks waiting for a thread, from any thread
+ *
+ * @param pool: The pool
+ * @return The approximate count
+ */
+size_t compute_pool_pending(const ComputePool_t *pool);
+
+/*
+ * Queue a task. The loop of base must be running with the libevent threads
+ * enabled, it runs the completion.
+ *
+ * @param pool: The pool
+ * @param base: The event loop of the request
+ * @param run: Called in a thread of the pool
+ * @param complete: Called in the loop once run returned
+ * @param data: The argument of both callbacks
+ * @return 0 when the queue is full, nothing will be called
+ */
+int compute_pool_submit(ComputePool_t *pool, struct event_base *base, ComputeCallback run, ComputeCallback complete,
+                        void *data);
+
+#endif
@@ -34,6 +34,7 @@
 #include "ini.h"
 #include "common.h"
 #include "log.h"
+#include "number.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -56,21 +57,56 @@ static Configuration_t *configuration_create(void)
 
     config->server.address = NULL;
     config->server.port = 0;
+    config->server.workers = 1;
+    config->server.io_uring = 0;
+    config->server.unix_socket = NULL;
 
     config->bounds.north = 0.0;
     config->bounds.south = 0.0;
     config->bounds.east = 0.0;
     config->bounds.west = 0.0;
 
-    config->excluded.lat = 0.0;
-    config->excluded.lng = 0.0;
+    exclusion_init(&config->excluded);
 
     config->database.database = NULL;
     config->database.username = NULL;
     config->database.password = NULL;
+    config->database.time_column = NULL;
     config->database.server.address = NULL;
     config->database.server.port = 0;
 
+    config->import.format = IMPORT_FORMAT_AUTO;
+    config->import.threads = 0;
+
+    config->shared.mode = SHARED_MODE_OFF;
+    config->shared.name = strdup("/geocluster");
+    config->shared.wait = 0;
+
+    config->regions.file = NULL;
+    config->regions.id_property = strdup("id");
+    config->regions.name_property = strdup("name");
+
+    config->output.precision = NUMBER_SHORTEST;
+
+    config->compression.level = 6;
+    config->compression.min_size = 1024;
+
+    config->cache.entries = 64;
+    config->cache.disk_min_size = 0;
+    config->cache.directory = strdup("/tmp");
+    config->cache.control = NULL;
+    config->compute.threads = 0;
+    config->compute.queue = 256;
+    config->compute.requests = 1024;
+    config->compute.deadline = 0;
+    config->compute.retry_after = 1;
+    config->degradation.queue = 0;
+    config->degradation.latency = 0;
+    config->degradation.size = 30;
+    config->affinity.server.count = 0;
+    config->affinity.compute.count = 0;
+    config->affinity.replicate = 0;
+
     return config;
 }
 
@@ -89,6 +125,19 @@ static void handle_section_server(Configuration_t *conf, const char *section, co
     {
         conf->server.port = (uint16_t) atoi(value);
     }
+    else if (!strcmp(name, "workers"))
+    {
+        conf->server.workers = atoi(value);
+    }
+    else if (!strcmp(name, "backend"))
+    {
+        conf->server.io_uring = !strcmp(value, "io_uring");
+    }
+    else if (!strcmp(name, "unix_socket"))
+    {
+        DELETE(conf->server.unix_socket);
+        conf->server.unix_socket = strdup(value);
+    }
 }
 
 static void handle_section_map(Configuration_t *conf, const char *section, const char *name, const char *value)
@@ -135,6 +184,10 @@ static void handle_section_database(Configuration_t *conf, const char *section,
     {
         conf->database.database = strdup(value);
     }
+    else if (!strcmp(name, "time_column"))
+    {
+        conf->database.time_column = strdup(value);
+    }
 
 }
 
@@ -144,15 +197,240 @@ static void handle_section_excluded(Configuration_t *conf, const char *section,
     {
         return;
     }
-    if (!strcmp(name, "lat"))
+
+    if (!exclusion_parse(&conf->excluded, name, value))
+    {
+        log_warning("Ignore the malformed exclusion %s = %s", name, value);
+    }
+}
+
+static void handle_section_import(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "import") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "format"))
+    {
+        conf->import.format = importer_format_from_string(value);
+    }
+    else if (!strcmp(name, "threads"))
+    {
+        conf->import.threads = atoi(value);
+    }
+}
+
+static void handle_section_shared(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "shared") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "name"))
+    {
+        DELETE(conf->shared.name);
+        conf->shared.name = strdup(value);
+    }
+    else if (!strcmp(name, "mode"))
+    {
+        if (!strcmp(value, "publish"))
+        {
+            conf->shared.mode = SHARED_MODE_PUBLISH;
+        }
+        else if (!strcmp(value, "attach"))
+        {
+            conf->shared.mode = SHARED_MODE_ATTACH;
+        }
+        else
+        {
+            conf->shared.mode = SHARED_MODE_OFF;
+        }
+    }
+    else if (!strcmp(name, "wait"))
+    {
+        conf->shared.wait = (unsigned int) strtoul(value, NULL, 10);
+    }
+}
+
+static void handle_section_regions(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "regions") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "file"))
+    {
+        DELETE(conf->regions.file);
+        conf->regions.file = strdup(value);
+    }
+    else if (!strcmp(name, "id"))
+    {
+        DELETE(conf->regions.id_property);
+        conf->regions.id_property = strdup(value);
+    }
+    else if (!strcmp(name, "name"))
+    {
+        DELETE(conf->regions.name_property);
+        conf->regions.name_property = strdup(value);
+    }
+}
+
+static void handle_section_output(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "output") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "precision"))
+    {
+        conf->output.precision = !strcmp(value, "shortest") ? NUMBER_SHORTEST : atoi(value);
+        if (conf->output.precision > 15)
+        {
+            log_warning("A precision of %s decimals isn't supported, use the shortest representation", value);
+            conf->output.precision = NUMBER_SHORTEST;
+        }
+    }
+}
+
+static void handle_section_compression(Configuration_t *conf, const char *section, const char *name,
+                                       const char *value)
+{
+    if (strcmp(section, "compression") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "level"))
+    {
+        conf->compression.level = atoi(value);
+        if (conf->compression.level > 9)
+        {
+            log_warning("The compression level %s is out of 0 to 9, use 9", value);
+            conf->compression.level = 9;
+        }
+    }
+    else if (!strcmp(name, "min_size"))
+    {
+        conf->compression.min_size = (size_t) strtoul(value, NULL, 10);
+    }
+}
+
+static void handle_section_cache(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "cache") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "entries"))
+    {
+        conf->cache.entries = (size_t) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "disk_min_size"))
+    {
+        conf->cache.disk_min_size = (size_t) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "directory"))
     {
-        conf->excluded.lat = atof(value);
+        DELETE(conf->cache.directory);
+        conf->cache.directory = strdup(value);
     }
-    else if (!strcmp(name, "lng"))
+    else if (!strcmp(name, "control"))
+    {
+        DELETE(conf->cache.control);
+        conf->cache.control = strdup(value);
+    }
+}
+
+static void handle_section_compute(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    if (strcmp(section, "compute") != 0)
     {
-        conf->excluded.lng = atof(value);
+        return;
     }
 
+    if (!strcmp(name, "threads"))
+    {
+        conf->compute.threads = atoi(value);
+    }
+    else if (!strcmp(name, "queue"))
+    {
+        conf->compute.queue = (size_t) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "requests"))
+    {
+        conf->compute.requests = (size_t) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "deadline"))
+    {
+        conf->compute.deadline = (unsigned int) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "retry_after"))
+    {
+        conf->compute.retry_after = (unsigned int) strtoul(value, NULL, 10);
+    }
+}
+
+static void handle_section_degradation(Configuration_t *conf, const char *section, const char *name,
+                                       const char *value)
+{
+    if (strcmp(section, "degradation") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "queue"))
+    {
+        conf->degradation.queue = (size_t) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "latency"))
+    {
+        conf->degradation.latency = (unsigned int) strtoul(value, NULL, 10);
+    }
+    else if (!strcmp(name, "size"))
+    {
+        int size = atoi(value);
+
+        if (size < 1 || size > 255)
+        {
+            log_warning("The degraded grid size %s is out of 1 to 255, keep %u", value, conf->degradation.size);
+            return;
+        }
+        conf->degradation.size = (uint8_t) size;
+    }
+}
+
+static void handle_section_affinity(Configuration_t *conf, const char *section, const char *name, const char *value)
+{
+    CpuList_t *cpus = NULL;
+
+    if (strcmp(section, "affinity") != 0)
+    {
+        return;
+    }
+
+    if (!strcmp(name, "server"))
+    {
+        cpus = &conf->affinity.server;
+    }
+    else if (!strcmp(name, "compute"))
+    {
+        cpus = &conf->affinity.compute;
+    }
+    else if (!strcmp(name, "replicate"))
+    {
+        conf->affinity.replicate = !strcmp(value, "on");
+    }
+
+    if (cpus && !affinity_parse(value, cpus))
+    {
+        log_warning("Ignore the malformed CPU list %s = %s", name, value);
+        cpus->count = 0;
+    }
 }
 
 static void handle_section_geocluster(Configuration_t *conf, const char *section, const char *name, const char *value)
@@ -176,11 +454,35 @@ static int handler(void *config, const char *section, const char *name, const ch
     handle_section_database(conf, section, name, value);
     handle_section_server(conf, section, name, value);
     handle_section_excluded(conf, section, name, value);
+    handle_section_import(conf, section, name, value);
+    handle_section_shared(conf, section, name, value);
+    handle_section_regions(conf, section, name, value);
+    handle_section_output(conf, section, name, value);
+    handle_section_compression(conf, section, name, value);
+    handle_section_cache(conf, section, name, value);
+    handle_section_compute(conf, section, name, value);
+    handle_section_degradation(conf, section, name, value);
+    handle_section_affinity(conf, section, name, value);
     handle_section_geocluster(conf, section, name, value);
 
     return 0;
 }
 
+/*
+ * Override a configuration string with an environment variable, when it's set.
+ * The file is not mandatory for the database when the points come from a file.
+ */
+static void read_environment(char **field, const char *variable)
+{
+    const char *value = getenv(variable);
+
+    if (value)
+    {
+        DELETE(*field);
+        *field = strdup(value);
+    }
+}
+
 Configuration_t *configuration_read(const char *config_path)
 {
     Configuration_t *configuration;
@@ -194,12 +496,16 @@ Configuration_t *configuration_read(const char *config_path)
     file_ensure_exists(config_path);
     configuration = configuration_create();
     ini_parse(config_path, handler, configuration);
+    exclusion_finish(&configuration->excluded);
 
-    configuration->database.username = getenv("DB_USERNAME");
-    configuration->database.password = getenv("DB_PASSWORD");
-    configuration->database.server.address = getenv("DB_HOST");
-    configuration->database.database = getenv("DB_DATABASE");
-    configuration->database.server.port = atoi( getenv("DB_PORT"));
+    read_environment(&configuration->database.username, "DB_USERNAME");
+    read_environment(&configuration->database.password, "DB_PASSWORD");
+    read_environment(&configuration->database.server.address, "DB_HOST");
+    read_environment(&configuration->database.database, "DB_DATABASE");
+    if (getenv("DB_PORT"))
+    {
+        configuration->database.server.port = (uint16_t) atoi(getenv("DB_PORT"));
+    }
 
     return configuration;
 }
@@ -209,10 +515,19 @@ void configuration_dispose(Configuration_t *config)
     if (config)
     {
         DELETE(config->server.address);
+        DELETE(config->server.unix_socket);
         DELETE(config->database.server.address);
         DELETE(config->database.database);
         DELETE(config->database.username);
         DELETE(config->database.password);
+        DELETE(config->database.time_column);
+        exclusion_dispose(&config->excluded);
+        DELETE(config->shared.name);
+        DELETE(config->regions.file);
+        DELETE(config->regions.id_property);
+        DELETE(config->regions.name_property);
+        DELETE(config->cache.directory);
+        DELETE(config->cache.control);
 
         free(config);
     }
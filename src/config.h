@@ -33,6 +33,9 @@
 #define __CONFIG_H___
 
 #include "point.h"
+#include "importer.h"
+#include "exclusion.h"
+#include "affinity.h"
 #include <stdint.h>
 #include <mysql.h>
 
@@ -48,6 +51,9 @@ typedef struct
 {
     uint16_t port;
     char *address;
+    int workers;
+    int io_uring;
+    char *unix_socket;
 } ServerConfig_t;
 
 typedef struct
@@ -56,16 +62,95 @@ typedef struct
     char *username;
     char *password;
     char *database;
+    char *time_column;
     MYSQL *db;
 } DatabaseConfig_t;
 
+typedef struct
+{
+    ImportFormat_t format;
+    int threads;
+} ImportConfig_t;
+
+typedef enum
+{
+    SHARED_MODE_OFF,
+    SHARED_MODE_PUBLISH,
+    SHARED_MODE_ATTACH,
+} SharedMode_t;
+
+typedef struct
+{
+    SharedMode_t mode;
+    char *name;
+    unsigned int wait;
+} SharedConfig_t;
+
+typedef struct
+{
+    char *file;
+    char *id_property;
+    char *name_property;
+} RegionsConfig_t;
+
+typedef struct
+{
+    int precision;
+} OutputConfig_t;
+
+typedef struct
+{
+    int level;
+    size_t min_size;
+} CompressionConfig_t;
+
+typedef struct
+{
+    size_t entries;
+    size_t disk_min_size;
+    char *directory;
+    char *control;
+} CacheConfig_t;
+
+typedef struct
+{
+    int threads;
+    size_t queue;
+    size_t requests;
+    unsigned int deadline;
+    unsigned int retry_after;
+} ComputeConfig_t;
+
+typedef struct
+{
+    size_t queue;
+    unsigned int latency;
+    uint8_t size;
+} DegradationConfig_t;
+
+typedef struct
+{
+    CpuList_t server;
+    CpuList_t compute;
+    int replicate;
+} AffinityConfig_t;
+
 typedef struct
 {
     uint8_t width, height;
-    LatLng_t excluded;
+    ExclusionList_t excluded;
     Bound_t bounds;
     ServerConfig_t server;
     DatabaseConfig_t database;
+    ImportConfig_t import;
+    SharedConfig_t shared;
+    RegionsConfig_t regions;
+    OutputConfig_t output;
+    CompressionConfig_t compression;
+    CacheConfig_t cache;
+    ComputeConfig_t compute;
+    DegradationConfig_t degradation;
+    AffinityConfig_t affinity;
     char *logfile;
 } Configuration_t;
 
@@ -33,7 +33,11 @@
 #include "database.h"
 #include "log.h"
 
+#include <ctype.h>
 #include <memory.h>
+#include <stdio.h>
+
+#define QUERY_SIZE 512
 
 
 /*
@@ -65,34 +69,56 @@ MYSQL *database_connect(Configuration_t *config)
     return db;
 }
 
-PointArray_t *database_execute(MYSQL * db)
+/*
+ * The column name comes from the configuration, only accept an identifier
+ */
+static int is_identifier(const char *name)
+{
+    if (!name || !*name)
+    {
+        return 0;
+    }
+    for (; *name; name++)
+    {
+        if (!isalnum((unsigned char) *name) && *name != '_')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+PointArray_t *database_execute(MYSQL * db, const char *time_column)
 {
     MYSQL_RES *db_result = NULL;
     MYSQL_ROW row = NULL;
     PointArray_t *points_array = NULL;
     my_ulonglong num_rows = 0;
+    char query[QUERY_SIZE];
+    char time_select[128] = "0";
     int result = 0;
 
-    result = mysql_query(db,
-                         "SELECT "
-                            "id, "
-                            "latti AS lat, "
-                            "longi AS lng, "
-                            "disappeared, "
-                            "`desc` "
-                        "FROM bandcochon_picture "
-                        "WHERE "
-                            "id NOT IN "
-                                "(SELECT "
-                                    "id "
-                                "FROM  "
-                                    "bandcochon_picture "
-                                "WHERE "
-                                    "latti <= -21.121154270682 AND "
-                                    "latti >= -21.121154270683 AND "
-                                    "longi >= 55.5273274366760 AND "
-                                    "longi <= 55.5273274366761) "
-                            "AND trash=0");
+    if (time_column && !is_identifier(time_column))
+    {
+        log_warning("Ignore the invalid time column %s", time_column);
+    }
+    else if (time_column)
+    {
+        snprintf(time_select, sizeof(time_select), "COALESCE(UNIX_TIMESTAMP(`%s`), 0)", time_column);
+    }
+
+    snprintf(query, sizeof(query),
+             "SELECT "
+                "id, "
+                "latti AS lat, "
+                "longi AS lng, "
+                "disappeared, "
+                "`desc`, "
+                "%s AS time "
+             "FROM bandcochon_picture "
+             "WHERE trash=0", time_select);
+
+    result = mysql_query(db, query);
 
     if (result)
     {
@@ -119,6 +145,7 @@ PointArray_t *database_execute(MYSQL * db)
         char *desc = strlen(row[4]) > 0 ? strdup(row[4]) : NULL;
 
         Point_t *p = point_create(lat, lng, disa, pk, desc);
+        p->time = (uint32_t) strtoul(row[5], NULL, 10);
         points_array_add_point(points_array, p);
     }
 
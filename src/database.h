@@ -47,9 +47,10 @@ MYSQL *database_connect(Configuration_t *config);
 /*
  * Execute the regular query.
  *
- * @param config: The configuration structure
+ * @param db: The MySQL connection
+ * @param time_column: The picture date column, loaded as a UNIX timestamp, or NULL
  * @return The array of Point_t or NULL
  */
-PointArray_t *database_execute(MYSQL *db);
+PointArray_t *database_execute(MYSQL *db, const char *time_column);
 
 #endif
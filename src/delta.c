@@ -0,0 +1,115 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "delta.h"
+#include "convert.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+/* The error allowed on the alignment, in cells */
+#define DELTA_EPSILON 1e-6
+
+void delta_token_write(const Viewport_t *viewport, char *token)
+{
+    snprintf(token, DELTA_TOKEN_SIZE, "%" PRIx64 "_%.17g_%.17g_%.17g_%.17g_%d_%" PRIu32 "_%" PRIu32 "_%u_%u",
+             viewport->version, viewport->bounds.north, viewport->bounds.south, viewport->bounds.east,
+             viewport->bounds.west, viewport->clusterize, viewport->since, viewport->until, viewport->width,
+             viewport->height);
+}
+
+int delta_token_read(const char *token, Viewport_t *viewport)
+{
+    unsigned int width = 0, height = 0;
+    int end = 0;
+
+    if (sscanf(token, "%" SCNx64 "_%lf_%lf_%lf_%lf_%d_%" SCNu32 "_%" SCNu32 "_%u_%u%n", &viewport->version,
+               &viewport->bounds.north, &viewport->bounds.south, &viewport->bounds.east, &viewport->bounds.west,
+               &viewport->clusterize, &viewport->since, &viewport->until, &width, &height, &end) != 10 ||
+        token[end] || !width || !height || width > UINT8_MAX || height > UINT8_MAX)
+    {
+        return 0;
+    }
+    viewport->width = (uint8_t) width;
+    viewport->height = (uint8_t) height;
+
+    return isfinite(viewport->bounds.north) && isfinite(viewport->bounds.south) &&
+           isfinite(viewport->bounds.east) && isfinite(viewport->bounds.west);
+}
+
+/*
+ * Get the whole number of cells in a distance, if it's one
+ */
+static int whole_cells(double distance, double cell, int *cells)
+{
+    double count = distance / cell;
+
+    if (fabs(count - round(count)) > DELTA_EPSILON || fabs(count) > INT32_MAX)
+    {
+        return 0;
+    }
+
+    *cells = (int) round(count);
+    return 1;
+}
+
+int delta_shift(const Viewport_t *previous, const Viewport_t *current, Shift_t *shift)
+{
+    uint8_t width = current->width;
+    uint8_t height = current->height;
+    /* The cells are cut in converted degrees, like the clustering does */
+    double north = convert_lat_from_gps(current->bounds.north);
+    double west = convert_lng_from_gps(current->bounds.west);
+    double cell_lat = (convert_lat_from_gps(current->bounds.south) - north) / height;
+    double cell_lng = (convert_lng_from_gps(current->bounds.east) - west) / width;
+    double previous_north = convert_lat_from_gps(previous->bounds.north);
+    double previous_west = convert_lng_from_gps(previous->bounds.west);
+    double previous_lat = (convert_lat_from_gps(previous->bounds.south) - previous_north) / height;
+    double previous_lng = (convert_lng_from_gps(previous->bounds.east) - previous_west) / width;
+
+    if (previous->version != current->version || previous->clusterize != current->clusterize ||
+        previous->since != current->since || previous->until != current->until ||
+        previous->width != width || previous->height != height)
+    {
+        return 0;
+    }
+
+    if (cell_lat == 0. || cell_lng == 0. ||
+        fabs(previous_lat - cell_lat) > DELTA_EPSILON * fabs(cell_lat) ||
+        fabs(previous_lng - cell_lng) > DELTA_EPSILON * fabs(cell_lng))
+    {
+        return 0;
+    }
+
+    return whole_cells(north - previous_north, cell_lat, &shift->rows) &&
+           whole_cells(west - previous_west, cell_lng, &shift->columns);
+}
@@ -0,0 +1,111 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Enough for the version, four doubles with %.17g and the other fields */
+#define DELTA_TOKEN_SIZE 160
+
+/*
+ * What a response was computed from, given back by the client as a token to
+ * get only the difference with its next viewport.
+ */
+typedef struct Viewport_t
+{
+    uint64_t version;
+    Bound_t bounds;
+    int clusterize;
+    uint32_t since, until;
+    uint8_t width, height;
+} Viewport_t;
+
+/*
+ * How many cells the grid moved between two aligned viewports: the cell
+ * (i, j) of the new grid is the cell (i + rows, j + columns) of the previous one.
+ */
+typedef struct Shift_t
+{
+    int rows, columns;
+} Shift_t;
+
+/*
+ * Write the token of a viewport, it needs no escaping in a query string
+ *
+ * @param viewport: The viewport
+ * @param token: Where to write the token, DELTA_TOKEN_SIZE bytes
+ */
+void delta_token_write(const Viewport_t *viewport, char *token);
+
+/*
+ * Read a token
+ *
+ * @param token: The token sent by the client
+ * @param viewport: Where to store the viewport
+ * @return 1 if the token is well formed
+ */
+int delta_token_read(const char *token, Viewport_t *viewport);
+
+/*
+ * Check the cells of the previous viewport are cells of the current one:
+ * same data, same grid, same cell size and a move of a whole number of cells.
+ *
+ * @param previous: The viewport of the client
+ * @param current: The requested viewport
+ * @param shift: Where to store the move
+ * @return 1 if the grids are aligned
+ */
+int delta_shift(const Viewport_t *previous, const Viewport_t *current, Shift_t *shift);
+
+/*
+ * Check a cell of the current grid was in the previous one
+ *
+ * @param shift: The move between the grids
+ * @param width: The columns of both grids
+ * @param height: The rows of both grids
+ * @param row: The row in the current grid
+ * @param column: The column in the current grid
+ * @return 1 if the client already has the cell
+ */
+static inline int delta_was_visible(const Shift_t *shift, int width, int height, int row, int column)
+{
+    row += shift->rows;
+    column += shift->columns;
+
+    return row >= 0 && row < height && column >= 0 && column < width;
+}
+
+#endif
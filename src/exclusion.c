@@ -0,0 +1,360 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "exclusion.h"
+#include "convert.h"
+#include "common.h"
+#include "log.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The SQL query used to exclude a 1e-12 wide window around the point */
+#define EXCLUSION_EPSILON 1e-12
+
+#define PENDING_LAT 1
+#define PENDING_LNG 2
+
+void exclusion_init(ExclusionList_t *list)
+{
+    list->zones = NULL;
+    list->length = 0;
+    list->pending.lat = 0.;
+    list->pending.lng = 0.;
+    list->pending_mask = 0;
+}
+
+void exclusion_dispose(ExclusionList_t *list)
+{
+    for (size_t i = 0; i < list->length; i++)
+    {
+        DELETE(list->zones[i].name);
+        DELETE(list->zones[i].vertices);
+    }
+    DELETE(list->zones);
+    exclusion_init(list);
+}
+
+static ExclusionZone_t *exclusion_add(ExclusionList_t *list, ExclusionKind_t kind)
+{
+    ExclusionZone_t *zone;
+
+    list->zones = realloc(list->zones, sizeof(ExclusionZone_t) * (list->length + 1));
+    if (!list->zones)
+    {
+        log_critical("Memory error while allocating the exclusion zones");
+        exit(EXIT_FAILURE);
+    }
+
+    zone = &list->zones[list->length++];
+    memset(zone, 0, sizeof(ExclusionZone_t));
+    zone->kind = kind;
+
+    return zone;
+}
+
+static void exclusion_add_point(ExclusionList_t *list, double lat, double lng)
+{
+    ExclusionZone_t *zone = exclusion_add(list, EXCLUSION_POINT);
+
+    zone->north = lat + EXCLUSION_EPSILON;
+    zone->south = lat - EXCLUSION_EPSILON;
+    zone->east = lng + EXCLUSION_EPSILON;
+    zone->west = lng - EXCLUSION_EPSILON;
+}
+
+static ExclusionZone_t *exclusion_find_polygon(ExclusionList_t *list, const char *name)
+{
+    ExclusionZone_t *zone;
+
+    for (size_t i = 0; i < list->length; i++)
+    {
+        if (list->zones[i].kind == EXCLUSION_POLYGON && !strcmp(list->zones[i].name, name))
+        {
+            return &list->zones[i];
+        }
+    }
+
+    zone = exclusion_add(list, EXCLUSION_POLYGON);
+    zone->name = strdup(name);
+    zone->north = -INFINITY;
+    zone->south = INFINITY;
+    zone->east = -INFINITY;
+    zone->west = INFINITY;
+
+    return zone;
+}
+
+/*
+ * The vertices are added only once the whole value is read, a malformed
+ * value leaves the polygon as it was
+ */
+static int exclusion_parse_polygon(ExclusionList_t *list, const char *name, const char *value)
+{
+    ExclusionZone_t *zone;
+    LatLng_t *vertices = NULL;
+    size_t length = 0;
+    const char *p = value;
+
+    while (*p)
+    {
+        double lat, lng;
+        int consumed = 0;
+
+        if (sscanf(p, " %lf %lf %n", &lat, &lng, &consumed) != 2)
+        {
+            DELETE(vertices);
+            return 0;
+        }
+
+        vertices = realloc(vertices, sizeof(LatLng_t) * (length + 1));
+        if (!vertices)
+        {
+            log_critical("Memory error while allocating an exclusion polygon");
+            exit(EXIT_FAILURE);
+        }
+        vertices[length].lat = lat;
+        vertices[length].lng = lng;
+        length++;
+
+        p += consumed;
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+
+    if (!length)
+    {
+        return 0;
+    }
+
+    zone = exclusion_find_polygon(list, name);
+    zone->vertices = realloc(zone->vertices, sizeof(LatLng_t) * (zone->length + length));
+    if (!zone->vertices)
+    {
+        log_critical("Memory error while allocating an exclusion polygon");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        zone->vertices[zone->length++] = vertices[i];
+        zone->north = fmax(zone->north, vertices[i].lat);
+        zone->south = fmin(zone->south, vertices[i].lat);
+        zone->east = fmax(zone->east, vertices[i].lng);
+        zone->west = fmin(zone->west, vertices[i].lng);
+    }
+    free(vertices);
+
+    return 1;
+}
+
+void exclusion_finish(ExclusionList_t *list)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < list->length; i++)
+    {
+        ExclusionZone_t *zone = &list->zones[i];
+
+        if (zone->kind == EXCLUSION_POLYGON && zone->length < 3)
+        {
+            log_warning("Ignore the exclusion polygon %s of %zu vertices", zone->name, zone->length);
+            DELETE(zone->name);
+            DELETE(zone->vertices);
+            continue;
+        }
+        list->zones[kept++] = *zone;
+    }
+
+    list->length = kept;
+}
+
+int exclusion_parse(ExclusionList_t *list, const char *name, const char *value)
+{
+    double a, b, c, d;
+
+    if (!strcmp(name, "lat") || !strcmp(name, "lng"))
+    {
+        if (!strcmp(name, "lat"))
+        {
+            list->pending.lat = atof(value);
+            list->pending_mask |= PENDING_LAT;
+        }
+        else
+        {
+            list->pending.lng = atof(value);
+            list->pending_mask |= PENDING_LNG;
+        }
+
+        if (list->pending_mask == (PENDING_LAT | PENDING_LNG))
+        {
+            exclusion_add_point(list, list->pending.lat, list->pending.lng);
+            list->pending_mask = 0;
+        }
+        return 1;
+    }
+
+    if (!strcmp(name, "point"))
+    {
+        if (sscanf(value, " %lf , %lf", &a, &b) != 2)
+        {
+            return 0;
+        }
+        exclusion_add_point(list, a, b);
+        return 1;
+    }
+
+    if (!strcmp(name, "box"))
+    {
+        ExclusionZone_t *zone;
+
+        if (sscanf(value, " %lf , %lf , %lf , %lf", &a, &b, &c, &d) != 4)
+        {
+            return 0;
+        }
+        zone = exclusion_add(list, EXCLUSION_BOX);
+        zone->north = fmax(a, b);
+        zone->south = fmin(a, b);
+        zone->east = fmax(c, d);
+        zone->west = fmin(c, d);
+        return 1;
+    }
+
+    if (!strncmp(name, "polygon", 7) && (name[7] == '\0' || name[7] == '.'))
+    {
+        return exclusion_parse_polygon(list, name[7] ? name + 8 : "", value);
+    }
+
+    return 0;
+}
+
+/*
+ * Even-odd rule, the polygon is implicitly closed
+ */
+static int polygon_contains(const ExclusionZone_t *zone, double lat, double lng)
+{
+    int inside = 0;
+
+    for (size_t i = 0, j = zone->length - 1; i < zone->length; j = i++)
+    {
+        const LatLng_t *a = &zone->vertices[i];
+        const LatLng_t *b = &zone->vertices[j];
+
+        if ((a->lat > lat) != (b->lat > lat) &&
+            lng < (b->lng - a->lng) * (lat - a->lat) / (b->lat - a->lat) + a->lng)
+        {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+int exclusion_contains(const ExclusionList_t *list, double lat, double lng)
+{
+    for (size_t i = 0; i < list->length; i++)
+    {
+        const ExclusionZone_t *zone = &list->zones[i];
+
+        if (lat < zone->south || lat > zone->north || lng < zone->west || lng > zone->east)
+        {
+            continue;
+        }
+
+        if (zone->kind != EXCLUSION_POLYGON || polygon_contains(zone, lat, lng))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+uint64_t exclusion_digest(const ExclusionList_t *list)
+{
+    uint64_t digest = 14695981039346656037ULL;
+
+    /* FNV-1a over the kind and the bounds or the vertices of every zone */
+    for (size_t i = 0; i < list->length; i++)
+    {
+        const ExclusionZone_t *zone = &list->zones[i];
+        double values[4] = {zone->north, zone->south, zone->east, zone->west};
+        const unsigned char *bytes = (const unsigned char *) values;
+        size_t size = sizeof(values);
+
+        if (zone->kind == EXCLUSION_POLYGON)
+        {
+            bytes = (const unsigned char *) zone->vertices;
+            size = sizeof(LatLng_t) * zone->length;
+        }
+
+        digest = (digest ^ (unsigned) zone->kind) * 1099511628211ULL;
+        for (size_t j = 0; j < size; j++)
+        {
+            digest = (digest ^ bytes[j]) * 1099511628211ULL;
+        }
+    }
+
+    return digest;
+}
+
+size_t exclusion_apply(const ExclusionList_t *list, PointArray_t *points_array)
+{
+    size_t kept = 0, length = points_array->position;
+
+    if (!list->length)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        Point_t *point = points_array->points[i];
+
+        if (exclusion_contains(list, convert_lat_to_gps(point->position.lat),
+                               convert_lng_to_gps(point->position.lng)))
+        {
+            point_dispose(point);
+            continue;
+        }
+        points_array->points[kept++] = point;
+    }
+
+    points_array->length = kept;
+    points_array->position = (uint32_t) kept;
+
+    log_info("%zu points removed by %zu exclusion zones", length - kept, list->length);
+
+    return length - kept;
+}
@@ -0,0 +1,114 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __EXCLUSION_H__
+#define __EXCLUSION_H__
+
+#include "point.h"
+#include "points_array.h"
+
+#include <stddef.h>
+
+typedef enum ExclusionKind_t
+{
+    EXCLUSION_POINT,
+    EXCLUSION_BOX,
+    EXCLUSION_POLYGON,
+} ExclusionKind_t;
+
+typedef struct ExclusionZone_t
+{
+    ExclusionKind_t kind;
+    char *name;
+    double north, south, east, west;
+    LatLng_t *vertices;
+    size_t length;
+} ExclusionZone_t;
+
+typedef struct ExclusionList_t
+{
+    ExclusionZone_t *zones;
+    size_t length;
+
+    LatLng_t pending;
+    int pending_mask;
+} ExclusionList_t;
+
+/*
+ * Initialize an empty exclusion list
+ */
+void exclusion_init(ExclusionList_t *list);
+
+/*
+ * Release the zones of the list
+ */
+void exclusion_dispose(ExclusionList_t *list);
+
+/*
+ * Add a zone from an [excluded] configuration entry. Coordinates are GPS degrees.
+ *
+ *   point = lat, lng
+ *   box = north, south, east, west
+ *   polygon.NAME = lat lng, lat lng, ...   (repeat the key to add more vertices)
+ *   lat = ... / lng = ...                  (legacy single point)
+ *
+ * @param list: The exclusion list
+ * @param name: The entry name
+ * @param value: The entry value
+ * @return 1 on success, 0 if the entry is malformed
+ */
+int exclusion_parse(ExclusionList_t *list, const char *name, const char *value);
+
+/*
+ * Drop the polygons of fewer than 3 vertices, once the configuration is read
+ */
+void exclusion_finish(ExclusionList_t *list);
+
+/*
+ * Check if a GPS position is in one of the zones
+ */
+int exclusion_contains(const ExclusionList_t *list, double lat, double lng);
+
+/*
+ * Hash the zones of the list, see region_digest
+ */
+uint64_t exclusion_digest(const ExclusionList_t *list);
+
+/*
+ * Remove and dispose the excluded points, once, when the points are loaded.
+ *
+ * @param list: The exclusion list
+ * @param points_array: The loaded points
+ * @return The number of removed points
+ */
+size_t exclusion_apply(const ExclusionList_t *list, PointArray_t *points_array);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "export.h"
+#include "convert.h"
+#include "json_writer.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+/* The rows written at once */
+#define EXPORT_BATCH (64 * 1024)
+
+/* The next batch is written when the connection has less than this to send */
+#define EXPORT_LOW_WATERMARK (128 * 1024)
+
+typedef struct Export_t
+{
+    struct evhttp_request *req;
+    struct evhttp_connection *connection;
+    Point_t **points;
+    size_t length;
+    size_t next;
+    size_t rows;
+    double north, south, east, west;
+    int precision;
+} Export_t;
+
+static void export_continue(struct evhttp_connection *connection, void *arg);
+
+static void export_write_row(JsonWriter_t *writer, const Point_t *point)
+{
+    JSON_WRITE_LITERAL(writer, "{\"id\":");
+    json_writer_integer(writer, point->pk);
+    JSON_WRITE_LITERAL(writer, ",\"lat\":");
+    json_writer_double(writer, convert_lat_to_gps(point->position.lat));
+    JSON_WRITE_LITERAL(writer, ",\"lng\":");
+    json_writer_double(writer, convert_lng_to_gps(point->position.lng));
+    if (point->disappeared)
+    {
+        JSON_WRITE_LITERAL(writer, ",\"disappeared\":true");
+    }
+    else
+    {
+        JSON_WRITE_LITERAL(writer, ",\"disappeared\":false");
+    }
+    JSON_WRITE_LITERAL(writer, ",\"time\":");
+    json_writer_integer(writer, point->time);
+    if (point->desc && json_writer_valid_utf8(point->desc))
+    {
+        JSON_WRITE_LITERAL(writer, ",\"desc\":");
+        json_writer_string(writer, point->desc);
+    }
+    JSON_WRITE_LITERAL(writer, "}\n");
+}
+
+/*
+ * Restore the connection for the next requests and release the export
+ */
+static void export_dispose(Export_t *export)
+{
+    struct bufferevent *bev = evhttp_connection_get_bufferevent(export->connection);
+
+    bufferevent_setwatermark(bev, EV_WRITE, 0, 0);
+    evhttp_connection_set_closecb(export->connection, NULL, NULL);
+    free(export);
+}
+
+static void export_on_close(struct evhttp_connection *connection, void *arg)
+{
+    Export_t *export = (Export_t *) arg;
+
+    (void) connection;
+    log_warning("The export was interrupted after %zu points", export->rows);
+
+    /* The request is freed by libevent */
+    evhttp_connection_set_closecb(export->connection, NULL, NULL);
+    free(export);
+}
+
+/*
+ * Write the next batch, called when the connection is ready for more
+ */
+static void export_continue(struct evhttp_connection *connection, void *arg)
+{
+    Export_t *export = (Export_t *) arg;
+    struct evbuffer *buf = evbuffer_new();
+    struct evhttp_request *req = NULL;
+    JsonWriter_t writer;
+
+    (void) connection;
+
+    json_writer_init(&writer, buf, export->precision);
+    for (; export->next < export->length && json_writer_length(&writer) < EXPORT_BATCH; export->next++)
+    {
+        const Point_t *point = export->points[export->next];
+
+        if (point->position.lat < export->north || point->position.lat > export->south ||
+            point->position.lng < export->west || point->position.lng > export->east)
+        {
+            continue;
+        }
+
+        export_write_row(&writer, point);
+        export->rows++;
+    }
+    json_writer_finish(&writer);
+
+    if (export->next < export->length)
+    {
+        evhttp_send_reply_chunk_with_cb(export->req, buf, export_continue, export);
+        evbuffer_free(buf);
+        return;
+    }
+
+    evhttp_send_reply_chunk(export->req, buf);
+    evbuffer_free(buf);
+
+    log_info("Exported %zu points", export->rows);
+    req = export->req;
+    export_dispose(export);
+    evhttp_send_reply_end(req);
+}
+
+void export_points(struct evhttp_request *req, const PointArray_t *points, Bound_t bounds, int precision)
+{
+    Export_t *export = (Export_t *) malloc(sizeof(Export_t));
+
+    if (!export)
+    {
+        log_critical("Unable to allocate an export");
+        exit(EXIT_FAILURE);
+    }
+
+    export->req = req;
+    export->connection = evhttp_request_get_connection(req);
+    export->points = points->points;
+    export->length = points->length;
+    export->next = 0;
+    export->rows = 0;
+    export->precision = precision;
+
+    /* Same bounds test as the clustering, in converted degrees */
+    export->north = convert_lat_from_gps(bounds.north);
+    export->south = convert_lat_from_gps(bounds.south);
+    export->east = convert_lng_from_gps(bounds.east);
+    export->west = convert_lng_from_gps(bounds.west);
+
+    bufferevent_setwatermark(evhttp_connection_get_bufferevent(export->connection), EV_WRITE,
+                             EXPORT_LOW_WATERMARK, 0);
+    evhttp_connection_set_closecb(export->connection, export_on_close, export);
+
+    evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "application/x-ndjson");
+    evhttp_send_reply_start(req, 200, "OK");
+
+    export_continue(export->connection, export);
+}
@@ -0,0 +1,229 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "flight.h"
+#include "response_cache.h"
+#include "common.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct FlightWaiter_t
+{
+    FlightCallback callback;
+    void *data;
+    Body_t *body;
+    Flight_t *flight;
+    struct event *landed;
+    FlightWaiter_t *next;
+};
+
+FlightTable_t *flight_table_create(void)
+{
+    FlightTable_t *table = (FlightTable_t *) malloc(sizeof(FlightTable_t));
+
+    if (!table)
+    {
+        log_critical("Unable to allocate the flight table");
+        exit(EXIT_FAILURE);
+    }
+
+    table->flights = NULL;
+    pthread_mutex_init(&table->lock, NULL);
+
+    return table;
+}
+
+void flight_table_dispose(FlightTable_t *table)
+{
+    if (!table)
+    {
+        return;
+    }
+
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+/*
+ * The computation and every waiter hold a reference
+ */
+static void flight_release(Flight_t *flight)
+{
+    if (__atomic_sub_fetch(&flight->references, 1, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    DELETE(flight->key);
+    free(flight);
+}
+
+/*
+ * In the loop of the waiter
+ */
+static void on_landed(evutil_socket_t fd, short what, void *arg)
+{
+    FlightWaiter_t *waiter = (FlightWaiter_t *) arg;
+
+    (void) fd;
+    (void) what;
+
+    waiter->callback(waiter->body, waiter->data);
+    body_release(waiter->body);
+    flight_release(waiter->flight);
+    event_free(waiter->landed);
+    free(waiter);
+}
+
+Flight_t *flight_join(FlightTable_t *table, const char *key, struct event_base *base, FlightCallback callback,
+                      void *data, int *first)
+{
+    FlightWaiter_t *waiter = (FlightWaiter_t *) malloc(sizeof(FlightWaiter_t));
+    uint64_t hash = response_cache_hash(key);
+    Flight_t *flight = NULL;
+
+    if (!waiter)
+    {
+        log_critical("Unable to allocate a flight waiter");
+        exit(EXIT_FAILURE);
+    }
+
+    waiter->callback = callback;
+    waiter->data = data;
+    waiter->body = NULL;
+    waiter->landed = event_new(base, -1, 0, on_landed, waiter);
+
+    pthread_mutex_lock(&table->lock);
+
+    for (flight = table->flights; flight; flight = flight->next)
+    {
+        if (flight->hash == hash && !strcmp(flight->key, key))
+        {
+            __atomic_add_fetch(&flight->references, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&flight->waiting, 1, __ATOMIC_RELAXED);
+            waiter->flight = flight;
+            waiter->next = flight->waiters;
+            flight->waiters = waiter;
+            pthread_mutex_unlock(&table->lock);
+            *first = 0;
+            return flight;
+        }
+    }
+
+    flight = (Flight_t *) malloc(sizeof(Flight_t));
+    if (!flight)
+    {
+        log_critical("Unable to allocate a flight");
+        exit(EXIT_FAILURE);
+    }
+
+    flight->key = strdup(key);
+    flight->hash = hash;
+    flight->references = 2;
+    flight->waiting = 1;
+    flight->listed = 1;
+    waiter->flight = flight;
+    waiter->next = NULL;
+    flight->waiters = waiter;
+    flight->next = table->flights;
+    table->flights = flight;
+
+    pthread_mutex_unlock(&table->lock);
+    *first = 1;
+
+    return flight;
+}
+
+/*
+ * Take the flight out of the table, locked
+ */
+static void flight_unlist(FlightTable_t *table, Flight_t *flight)
+{
+    Flight_t **link = NULL;
+
+    for (link = &table->flights; *link != flight; link = &(*link)->next)
+    {
+    }
+    *link = flight->next;
+    flight->listed = 0;
+}
+
+void flight_leave(FlightTable_t *table, Flight_t *flight)
+{
+    pthread_mutex_lock(&table->lock);
+    if (!__atomic_sub_fetch(&flight->waiting, 1, __ATOMIC_RELEASE) && flight->listed)
+    {
+        flight_unlist(table, flight);
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+int flight_abandoned(const Flight_t *flight)
+{
+    return __atomic_load_n(&flight->waiting, __ATOMIC_ACQUIRE) == 0;
+}
+
+void flight_land(FlightTable_t *table, Flight_t *flight, Body_t *body)
+{
+    FlightWaiter_t *waiters = NULL;
+    FlightWaiter_t *waiter = NULL;
+    FlightWaiter_t *next = NULL;
+    size_t count = 0;
+
+    /* The next requests of the key start a new flight, or find the cache */
+    pthread_mutex_lock(&table->lock);
+    if (flight->listed)
+    {
+        flight_unlist(table, flight);
+    }
+    waiters = flight->waiters;
+    pthread_mutex_unlock(&table->lock);
+
+    for (waiter = waiters; waiter; waiter = waiter->next)
+    {
+        count++;
+    }
+    if (count > 1)
+    {
+        log_debug("%zu requests shared the computation of %s", count, flight->key);
+    }
+
+    for (waiter = waiters; waiter; waiter = next)
+    {
+        next = waiter->next;
+        waiter->body = body ? body_retain(body) : NULL;
+        event_active(waiter->landed, EV_TIMEOUT, 1);
+    }
+
+    flight_release(flight);
+}
@@ -0,0 +1,130 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FLIGHT_H__
+#define __FLIGHT_H__
+
+#include "body.h"
+
+#include <event2/event.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Called in the loop of a waiter with the computed body, NULL if the
+ * computation could not run. The body is released after the call.
+ */
+typedef void (*FlightCallback)(Body_t *body, void *data);
+
+typedef struct FlightWaiter_t FlightWaiter_t;
+
+/*
+ * A computation in progress and the requests waiting for it
+ */
+typedef struct Flight_t
+{
+    char *key;
+    uint64_t hash;
+    int references;
+    int waiting;
+
+    /* In the table, identical requests can still join it */
+    int listed;
+    FlightWaiter_t *waiters;
+    struct Flight_t *next;
+} Flight_t;
+
+/*
+ * The computations in progress, shared by the loops
+ */
+typedef struct
+{
+    Flight_t *flights;
+    pthread_mutex_t lock;
+} FlightTable_t;
+
+/*
+ * Create the table
+ *
+ * @return The table, without flight
+ */
+FlightTable_t *flight_table_create(void);
+
+/*
+ * Dispose the table, the flights still in progress are left alone
+ *
+ * @param table: The table
+ */
+void flight_table_dispose(FlightTable_t *table);
+
+/*
+ * Wait for the computation of a key, started by the first to join
+ *
+ * @param table: The table
+ * @param key: The normalized request
+ * @param base: The loop of the waiter, where the callback runs
+ * @param callback: Called with the body once computed
+ * @param data: The argument of the callback
+ * @param first: Set to 1 when the caller has to compute it, 0 if it is already in progress
+ * @return The flight, valid until the callback returns
+ */
+Flight_t *flight_join(FlightTable_t *table, const char *key, struct event_base *base, FlightCallback callback,
+                      void *data, int *first);
+
+/*
+ * A waiter is gone, its callback is still called. Once every waiter left,
+ * the flight leaves the table: the next identical request starts another one
+ * instead of joining a computation being abandoned.
+ *
+ * @param table: The table
+ * @param flight: The flight it joined
+ */
+void flight_leave(FlightTable_t *table, Flight_t *flight);
+
+/*
+ * Check if the computation is still awaited, from any thread
+ *
+ * @param flight: The flight
+ * @return 1 when every waiter left
+ */
+int flight_abandoned(const Flight_t *flight);
+
+/*
+ * Give the body to every waiter of the flight and forget the flight. The
+ * computation must not use it after.
+ *
+ * @param table: The table
+ * @param flight: The flight returned to the first to join
+ * @param body: The computed body, retained by each waiter, NULL on failure
+ */
+void flight_land(FlightTable_t *table, Flight_t *flight, Body_t *body);
+
+#endif
@@ -0,0 +1,948 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "importer.h"
+#include "number.h"
+#include "log.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SNIFF_SIZE 4096
+#define CSV_MAX_COLUMNS 32
+
+typedef enum ImportColumn_t
+{
+    COLUMN_IGNORED,
+    COLUMN_ID,
+    COLUMN_LAT,
+    COLUMN_LNG,
+    COLUMN_DISAPPEARED,
+    COLUMN_DESC,
+    COLUMN_TIME,
+} ImportColumn_t;
+
+typedef struct Span_t
+{
+    const char *begin;
+    const char *end;
+} Span_t;
+
+typedef struct ImportText_t
+{
+    char *data;
+    size_t capacity;
+} ImportText_t;
+
+/*
+ * The work given to a single parsing thread. CSV and NDJSON chunks are a byte
+ * span holding whole lines, GeoJSON chunks are a range of feature objects.
+ */
+typedef struct ImportChunk_t
+{
+    ImportFormat_t format;
+    Span_t span;
+    const Span_t *records;
+    size_t records_count;
+    const ImportColumn_t *columns;
+
+    Point_t **points;
+    size_t length, capacity;
+    size_t rejected;
+
+    ImportText_t field;
+    ImportText_t desc;
+} ImportChunk_t;
+
+/*
+ * The fields of one record while it's parsed
+ */
+typedef struct ImportRecord_t
+{
+    uint32_t pk;
+    uint32_t time;
+    double lat, lng;
+    char disappeared;
+    const char *desc;
+    int has_lat, has_lng;
+} ImportRecord_t;
+
+ImportFormat_t importer_format_from_string(const char *name)
+{
+    if (!name)
+    {
+        return IMPORT_FORMAT_AUTO;
+    }
+    if (!strcasecmp(name, "csv"))
+    {
+        return IMPORT_FORMAT_CSV;
+    }
+    if (!strcasecmp(name, "ndjson") || !strcasecmp(name, "jsonl"))
+    {
+        return IMPORT_FORMAT_NDJSON;
+    }
+    if (!strcasecmp(name, "geojson"))
+    {
+        return IMPORT_FORMAT_GEOJSON;
+    }
+
+    return IMPORT_FORMAT_AUTO;
+}
+
+static const char *FormatStr[] = {
+    "auto",
+    "csv",
+    "ndjson",
+    "geojson",
+};
+
+static inline const char *skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Find the end of the JSON string starting at p (p is on the opening quote).
+ *
+ * @return A pointer on the closing quote, or end
+ */
+static const char *json_string_end(const char *p, const char *end)
+{
+    for (p++; p < end; p++)
+    {
+        if (*p == '\\')
+        {
+            p++;
+        }
+        else if (*p == '"')
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+/*
+ * Find the end of the JSON object starting at p (p is on the opening brace).
+ *
+ * @return A pointer just after the closing brace, or NULL if the object is truncated
+ */
+static const char *json_object_end(const char *p, const char *end)
+{
+    int depth = 0;
+
+    for (; p < end; p++)
+    {
+        if (*p == '"')
+        {
+            p = json_string_end(p, end);
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            depth++;
+        }
+        else if ((*p == '}' || *p == ']') && --depth == 0)
+        {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static char *text_reserve(ImportText_t *text, size_t size)
+{
+    if (size <= text->capacity)
+    {
+        return text->data;
+    }
+
+    text->capacity = size * 2;
+    text->data = realloc(text->data, text->capacity);
+    if (!text->data)
+    {
+        log_critical("Memory error while allocating the import buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    return text->data;
+}
+
+static void chunk_add_point(ImportChunk_t *chunk, const ImportRecord_t *record)
+{
+    if (!record->has_lat || !record->has_lng)
+    {
+        chunk->rejected++;
+        return;
+    }
+
+    if (chunk->length == chunk->capacity)
+    {
+        chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+        chunk->points = realloc(chunk->points, sizeof(Point_t *) * chunk->capacity);
+        if (!chunk->points)
+        {
+            log_critical("Memory error while allocating imported points");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    chunk->points[chunk->length] = point_create(record->lat, record->lng, record->disappeared,
+                                                record->pk, record->desc);
+    chunk->points[chunk->length]->time = record->time;
+    chunk->length++;
+}
+
+static void utf8_encode(char **out, uint32_t code)
+{
+    char *o = *out;
+
+    if (code < 0x80)
+    {
+        *o++ = (char) code;
+    }
+    else if (code < 0x800)
+    {
+        *o++ = (char) (0xC0 | (code >> 6));
+        *o++ = (char) (0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+        *o++ = (char) (0xE0 | (code >> 12));
+        *o++ = (char) (0x80 | ((code >> 6) & 0x3F));
+        *o++ = (char) (0x80 | (code & 0x3F));
+    }
+    else
+    {
+        *o++ = (char) (0xF0 | (code >> 18));
+        *o++ = (char) (0x80 | ((code >> 12) & 0x3F));
+        *o++ = (char) (0x80 | ((code >> 6) & 0x3F));
+        *o++ = (char) (0x80 | (code & 0x3F));
+    }
+
+    *out = o;
+}
+
+static int hex4(const char *p, const char *end, uint32_t *code)
+{
+    *code = 0;
+    if (end - p < 4)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        *code <<= 4;
+        if (c >= '0' && c <= '9') *code |= (uint32_t) (c - '0');
+        else if (c >= 'a' && c <= 'f') *code |= (uint32_t) (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') *code |= (uint32_t) (c - 'A' + 10);
+        else return 0;
+    }
+    return 1;
+}
+
+/*
+ * Decode the JSON string between begin and end (quotes excluded) into the text buffer.
+ */
+static const char *json_unescape(ImportText_t *text, const char *begin, const char *end)
+{
+    char *o = text_reserve(text, (size_t) (end - begin) + 1);
+
+    for (const char *p = begin; p < end; p++)
+    {
+        uint32_t code, low;
+
+        if (*p != '\\' || p + 1 == end)
+        {
+            *o++ = *p;
+            continue;
+        }
+
+        switch (*++p)
+        {
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'n': *o++ = '\n'; break;
+            case 'r': *o++ = '\r'; break;
+            case 't': *o++ = '\t'; break;
+            case 'u':
+                if (!hex4(p + 1, end, &code))
+                {
+                    break;
+                }
+                p += 4;
+                if (code >= 0xD800 && code < 0xDC00 && end - p > 6 && p[1] == '\\' && p[2] == 'u'
+                    && hex4(p + 3, end, &low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                utf8_encode(&o, code);
+                break;
+            default:
+                *o++ = *p;
+        }
+    }
+
+    *o = '\0';
+    return text->data;
+}
+
+static int json_is_key(const char *begin, const char *end, const char *key)
+{
+    size_t length = strlen(key);
+    return (size_t) (end - begin) == length && !memcmp(begin, key, length);
+}
+
+/*
+ * Parse a flat JSON value as a boolean or a number.
+ */
+static const char *json_parse_flag(const char *p, const char *end, char *flag)
+{
+    double value;
+
+    if (end - p >= 4 && !memcmp(p, "true", 4))
+    {
+        *flag = 1;
+        return p + 4;
+    }
+    if (end - p >= 5 && !memcmp(p, "false", 5))
+    {
+        *flag = 0;
+        return p + 5;
+    }
+    if ((p = number_parse_double(p, end, &value)))
+    {
+        *flag = value != 0.;
+    }
+    return p;
+}
+
+/*
+ * Parse one NDJSON line or GeoJSON feature. Keys are matched wherever they
+ * appear, so "id" may live at the feature level or in its properties.
+ */
+static void parse_json_record(ImportChunk_t *chunk, const char *p, const char *end)
+{
+    ImportRecord_t record = {0, 0, 0., 0., 0, NULL, 0, 0};
+
+    while (p < end)
+    {
+        const char *key, *key_end;
+
+        if (*p != '"')
+        {
+            p++;
+            continue;
+        }
+
+        key = p + 1;
+        key_end = json_string_end(p, end);
+        if (key_end == end)
+        {
+            break;
+        }
+        p = skip_spaces(key_end + 1, end);
+        if (p == end || *p != ':')
+        {
+            continue;
+        }
+        p = skip_spaces(p + 1, end);
+
+        if (json_is_key(key, key_end, "lat") || json_is_key(key, key_end, "latti"))
+        {
+            const char *next = number_parse_double(p, end, &record.lat);
+            record.has_lat = next != NULL;
+            p = next ? next : p;
+        }
+        else if (json_is_key(key, key_end, "lng") || json_is_key(key, key_end, "lon") ||
+                 json_is_key(key, key_end, "longi"))
+        {
+            const char *next = number_parse_double(p, end, &record.lng);
+            record.has_lng = next != NULL;
+            p = next ? next : p;
+        }
+        else if (json_is_key(key, key_end, "coordinates") && p < end && *p == '[')
+        {
+            const char *next = number_parse_double(skip_spaces(p + 1, end), end, &record.lng);
+
+            if (next && (next = skip_spaces(next, end)) < end && *next == ',' &&
+                (next = number_parse_double(skip_spaces(next + 1, end), end, &record.lat)))
+            {
+                record.has_lat = record.has_lng = 1;
+                p = next;
+            }
+        }
+        else if (json_is_key(key, key_end, "id") || json_is_key(key, key_end, "pk"))
+        {
+            const char *next = number_parse_uint32(p < end && *p == '"' ? p + 1 : p, end, &record.pk);
+            p = next ? next : p;
+        }
+        else if (json_is_key(key, key_end, "time") || json_is_key(key, key_end, "timestamp"))
+        {
+            const char *next = number_parse_uint32(p, end, &record.time);
+            p = next ? next : p;
+        }
+        else if (json_is_key(key, key_end, "disappeared"))
+        {
+            const char *next = json_parse_flag(p, end, &record.disappeared);
+            p = next ? next : p;
+        }
+        else if (json_is_key(key, key_end, "desc") && p < end && *p == '"')
+        {
+            const char *value_end = json_string_end(p, end);
+            record.desc = value_end > p + 1 ? json_unescape(&chunk->desc, p + 1, value_end) : NULL;
+            p = value_end + 1;
+        }
+    }
+
+    chunk_add_point(chunk, &record);
+}
+
+/*
+ * Read one CSV field, unquoting it into the text buffer if needed.
+ *
+ * @return A pointer on the separator following the field, or end
+ */
+static const char *csv_field(ImportText_t *text, const char *p, const char *end, Span_t *field)
+{
+    char *o;
+
+    if (p == end || *p != '"')
+    {
+        field->begin = p;
+        while (p < end && *p != ',')
+        {
+            p++;
+        }
+        field->end = p;
+        while (field->end > field->begin && (field->end[-1] == '\r' || field->end[-1] == ' '))
+        {
+            field->end--;
+        }
+        return p;
+    }
+
+    o = text_reserve(text, (size_t) (end - p) + 1);
+    field->begin = o;
+
+    for (p++; p < end; p++)
+    {
+        if (*p == '"')
+        {
+            if (p + 1 < end && p[1] == '"')
+            {
+                *o++ = *p++;
+                continue;
+            }
+            p++;
+            break;
+        }
+        *o++ = *p;
+    }
+
+    *o = '\0';
+    field->end = o;
+
+    while (p < end && *p != ',')
+    {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Find the end of the CSV record at p, a quoted field may hold newlines.
+ *
+ * @param quoted: p is inside a quoted field
+ * @return The newline ending the record, or end
+ */
+static const char *csv_record_end(const char *p, const char *end, int quoted)
+{
+    for (;;)
+    {
+        const char *quote = memchr(p, '"', (size_t) (end - p));
+        const char *eol = quoted ? NULL : memchr(p, '\n', (size_t) ((quote ? quote : end) - p));
+
+        if (eol)
+        {
+            return eol;
+        }
+        if (!quote)
+        {
+            return end;
+        }
+
+        /* An escaped quote closes and opens the field again */
+        quoted = !quoted;
+        p = quote + 1;
+    }
+}
+
+/*
+ * Tell if stop is inside a quoted field, from the start of a record
+ */
+static int csv_is_quoted(const char *p, const char *stop)
+{
+    int quoted = 0;
+
+    while ((p = memchr(p, '"', (size_t) (stop - p))))
+    {
+        quoted = !quoted;
+        p++;
+    }
+
+    return quoted;
+}
+
+static void parse_csv_record(ImportChunk_t *chunk, const char *p, const char *end)
+{
+    ImportRecord_t record = {0, 0, 0., 0., 0, NULL, 0, 0};
+
+    for (int column = 0; p <= end && column < CSV_MAX_COLUMNS; column++)
+    {
+        Span_t field;
+        double value;
+
+        p = csv_field(&chunk->field, p, end, &field);
+
+        switch (chunk->columns[column])
+        {
+            case COLUMN_ID:
+                number_parse_uint32(field.begin, field.end, &record.pk);
+                break;
+            case COLUMN_LAT:
+                record.has_lat = number_parse_double(field.begin, field.end, &record.lat) == field.end;
+                break;
+            case COLUMN_LNG:
+                record.has_lng = number_parse_double(field.begin, field.end, &record.lng) == field.end;
+                break;
+            case COLUMN_TIME:
+                number_parse_uint32(field.begin, field.end, &record.time);
+                break;
+            case COLUMN_DISAPPEARED:
+                record.disappeared = number_parse_double(field.begin, field.end, &value) && value != 0.;
+                break;
+            case COLUMN_DESC:
+                if (field.end > field.begin)
+                {
+                    char *desc = text_reserve(&chunk->desc, (size_t) (field.end - field.begin) + 1);
+
+                    memcpy(desc, field.begin, (size_t) (field.end - field.begin));
+                    desc[field.end - field.begin] = '\0';
+                    record.desc = desc;
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (p == end)
+        {
+            break;
+        }
+        p++;
+    }
+
+    chunk_add_point(chunk, &record);
+}
+
+static void *parse_chunk(void *data)
+{
+    ImportChunk_t *chunk = (ImportChunk_t *) data;
+
+    if (chunk->format == IMPORT_FORMAT_GEOJSON)
+    {
+        for (size_t i = 0; i < chunk->records_count; i++)
+        {
+            parse_json_record(chunk, chunk->records[i].begin, chunk->records[i].end);
+        }
+        return NULL;
+    }
+
+    for (const char *p = chunk->span.begin; p < chunk->span.end;)
+    {
+        const char *eol = chunk->format == IMPORT_FORMAT_CSV
+                          ? csv_record_end(p, chunk->span.end, 0)
+                          : memchr(p, '\n', (size_t) (chunk->span.end - p));
+        if (!eol)
+        {
+            eol = chunk->span.end;
+        }
+
+        if (skip_spaces(p, eol) < eol)
+        {
+            if (chunk->format == IMPORT_FORMAT_CSV)
+            {
+                parse_csv_record(chunk, p, eol);
+            }
+            else
+            {
+                parse_json_record(chunk, p, eol);
+            }
+        }
+
+        p = eol + 1;
+    }
+
+    return NULL;
+}
+
+static ImportFormat_t guess_format(const char *filename, const char *content, size_t size)
+{
+    const char *extension = strrchr(filename, '.');
+    const char *p = skip_spaces(content, content + size);
+    size_t head = size < SNIFF_SIZE ? size : SNIFF_SIZE;
+
+    if (extension)
+    {
+        ImportFormat_t format = importer_format_from_string(extension + 1);
+        if (format != IMPORT_FORMAT_AUTO)
+        {
+            return format;
+        }
+    }
+
+    if (p < content + size && *p == '{')
+    {
+        return memmem(content, head, "\"features\"", 10) ? IMPORT_FORMAT_GEOJSON : IMPORT_FORMAT_NDJSON;
+    }
+
+    return IMPORT_FORMAT_CSV;
+}
+
+/*
+ * Read the CSV header if there's one and fill the column mapping.
+ *
+ * @return The first byte of data
+ */
+static const char *csv_read_header(const char *content, const char *end, ImportColumn_t *columns)
+{
+    static const ImportColumn_t Default[] = {
+        COLUMN_ID, COLUMN_LAT, COLUMN_LNG, COLUMN_DISAPPEARED, COLUMN_DESC, COLUMN_TIME
+    };
+    const char *eol = memchr(content, '\n', (size_t) (end - content));
+    const char *p = content;
+    int column = 0;
+
+    memset(columns, 0, sizeof(ImportColumn_t) * CSV_MAX_COLUMNS);
+    memcpy(columns, Default, sizeof(Default));
+
+    /* The UTF-8 byte order mark of some spreadsheets */
+    if (end - p >= 3 && !memcmp(p, "\xEF\xBB\xBF", 3))
+    {
+        content = p += 3;
+    }
+
+    if (p == end || (*p >= '0' && *p <= '9') || *p == '-' || *p == ',')
+    {
+        return content;
+    }
+
+    eol = eol ? eol : end;
+    memset(columns, 0, sizeof(ImportColumn_t) * CSV_MAX_COLUMNS);
+
+    while (p < eol && column < CSV_MAX_COLUMNS)
+    {
+        const char *q = p;
+        const char *name = p;
+        size_t length;
+
+        while (q < eol && *q != ',' && *q != '\r')
+        {
+            q++;
+        }
+        length = (size_t) (q - p);
+
+        /* A quoted name, "lat" */
+        if (length >= 2 && p[0] == '"' && q[-1] == '"')
+        {
+            name = p + 1;
+            length -= 2;
+        }
+
+#define COLUMN_IS(column_name) (length == strlen(column_name) && !strncasecmp(name, column_name, length))
+        if (COLUMN_IS("id") || COLUMN_IS("pk")) columns[column] = COLUMN_ID;
+        else if (COLUMN_IS("lat") || COLUMN_IS("latti")) columns[column] = COLUMN_LAT;
+        else if (COLUMN_IS("lng") || COLUMN_IS("lon") || COLUMN_IS("longi")) columns[column] = COLUMN_LNG;
+        else if (COLUMN_IS("disappeared")) columns[column] = COLUMN_DISAPPEARED;
+        else if (COLUMN_IS("desc")) columns[column] = COLUMN_DESC;
+        else if (COLUMN_IS("time") || COLUMN_IS("timestamp")) columns[column] = COLUMN_TIME;
+#undef COLUMN_IS
+
+        column++;
+        p = q < eol && *q == ',' ? q + 1 : eol;
+    }
+
+    return eol < end ? eol + 1 : end;
+}
+
+/*
+ * Collect the feature objects of a GeoJSON FeatureCollection.
+ */
+static Span_t *geojson_split_features(const char *content, const char *end, size_t *count)
+{
+    const char *p = memmem(content, (size_t) (end - content), "\"features\"", 10);
+    Span_t *records = NULL;
+    size_t capacity = 0;
+
+    *count = 0;
+    if (!p)
+    {
+        return NULL;
+    }
+
+    p = skip_spaces(p + 10, end);
+    if (p == end || *p != ':' || (p = skip_spaces(p + 1, end)) == end || *p != '[')
+    {
+        return NULL;
+    }
+
+    for (p++; p < end;)
+    {
+        const char *object_end;
+
+        p = skip_spaces(p, end);
+        if (p == end || *p == ']')
+        {
+            break;
+        }
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (*p != '{' || !(object_end = json_object_end(p, end)))
+        {
+            log_warning("Malformed GeoJSON feature at byte %ld", (long) (p - content));
+            break;
+        }
+
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            records = realloc(records, sizeof(Span_t) * capacity);
+            if (!records)
+            {
+                log_critical("Memory error while splitting GeoJSON features");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        records[*count].begin = p;
+        records[*count].end = object_end;
+        (*count)++;
+        p = object_end;
+    }
+
+    return records;
+}
+
+PointArray_t *importer_load(const char *filename, ImportFormat_t format, int threads)
+{
+    ImportColumn_t columns[CSV_MAX_COLUMNS];
+    ImportChunk_t *chunks = NULL;
+    pthread_t *workers = NULL;
+    PointArray_t *points_array = NULL;
+    Span_t *records = NULL;
+    struct stat info;
+    const char *content, *begin, *end;
+    size_t records_count = 0, total = 0, rejected = 0, size;
+    struct timespec start, stop;
+    int fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1 || fstat(fd, &info) == -1)
+    {
+        log_critical("Can't load file %s because: %s", filename, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    size = (size_t) info.st_size;
+    if (!size)
+    {
+        close(fd);
+        log_warning("The file %s is empty", filename);
+        return points_array_create(ARRAY_EMPTY);
+    }
+
+    content = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (content == MAP_FAILED)
+    {
+        log_critical("Unable to map %s because: %s", filename, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    madvise((void *) content, size, MADV_SEQUENTIAL);
+
+    if (format == IMPORT_FORMAT_AUTO)
+    {
+        format = guess_format(filename, content, size);
+    }
+
+    if (threads <= 0)
+    {
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads > 0 ? threads : 1;
+    }
+
+    begin = content;
+    end = content + size;
+
+    if (format == IMPORT_FORMAT_CSV)
+    {
+        begin = csv_read_header(begin, end, columns);
+    }
+    else if (format == IMPORT_FORMAT_GEOJSON)
+    {
+        records = geojson_split_features(begin, end, &records_count);
+        if ((size_t) threads > records_count)
+        {
+            threads = records_count ? (int) records_count : 1;
+        }
+    }
+
+    chunks = calloc((size_t) threads, sizeof(ImportChunk_t));
+    workers = calloc((size_t) threads, sizeof(pthread_t));
+    if (!chunks || !workers)
+    {
+        log_critical("Memory error while allocating import chunks");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        ImportChunk_t *chunk = &chunks[i];
+
+        chunk->format = format;
+        chunk->columns = columns;
+
+        if (format == IMPORT_FORMAT_GEOJSON)
+        {
+            size_t first = records_count * (size_t) i / (size_t) threads;
+            size_t last = records_count * (size_t) (i + 1) / (size_t) threads;
+
+            chunk->records = records + first;
+            chunk->records_count = last - first;
+        }
+        else
+        {
+            /* Move the proposed boundary to the start of the next record */
+            const char *stop = i == threads - 1 ? end : begin + (size_t) (end - begin) * (size_t) (i + 1) / (size_t) threads;
+            const char *eol = NULL;
+
+            chunk->span.begin = i ? chunks[i - 1].span.end : begin;
+            if (stop < chunk->span.begin)
+            {
+                stop = chunk->span.begin;
+            }
+            if (stop < end && format == IMPORT_FORMAT_CSV)
+            {
+                eol = csv_record_end(stop, end, csv_is_quoted(chunk->span.begin, stop));
+                eol = eol < end ? eol : NULL;
+            }
+            else if (stop < end)
+            {
+                eol = memchr(stop, '\n', (size_t) (end - stop));
+            }
+
+            chunk->span.end = i == threads - 1 ? end : (eol ? eol + 1 : end);
+            if (chunk->span.end < chunk->span.begin)
+            {
+                chunk->span.end = chunk->span.begin;
+            }
+        }
+    }
+
+    for (int i = 1; i < threads; i++)
+    {
+        if (pthread_create(&workers[i], NULL, parse_chunk, &chunks[i]))
+        {
+            log_critical("Unable to start an import thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    parse_chunk(&chunks[0]);
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (i)
+        {
+            pthread_join(workers[i], NULL);
+        }
+        total += chunks[i].length;
+        rejected += chunks[i].rejected;
+    }
+
+    points_array = points_array_create(total);
+    for (int i = 0; i < threads; i++)
+    {
+        for (size_t j = 0; j < chunks[i].length; j++)
+        {
+            points_array_add_point(points_array, chunks[i].points[j]);
+        }
+        DELETE(chunks[i].points);
+        DELETE(chunks[i].field.data);
+        DELETE(chunks[i].desc.data);
+    }
+
+    if (rejected)
+    {
+        log_warning("%zu records without position were ignored", rejected);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    log_info("Loaded %zu points from %s (%s) with %d threads in %.2f ms", total, filename, FormatStr[format],
+             threads, (stop.tv_sec - start.tv_sec) * 1000. + (stop.tv_nsec - start.tv_nsec) / 1e6);
+
+    munmap((void *) content, size);
+    DELETE(records);
+    DELETE(chunks);
+    DELETE(workers);
+
+    return points_array;
+}
@@ -0,0 +1,70 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __IMPORTER_H__
+#define __IMPORTER_H__
+
+#include "points_array.h"
+
+typedef enum ImportFormat_t
+{
+    IMPORT_FORMAT_AUTO,
+    IMPORT_FORMAT_CSV,
+    IMPORT_FORMAT_NDJSON,
+    IMPORT_FORMAT_GEOJSON,
+} ImportFormat_t;
+
+/*
+ * Get the import format from its configuration name (auto, csv, ndjson or geojson).
+ *
+ * @param name: The format name
+ * @return The format, IMPORT_FORMAT_AUTO if the name is unknown
+ */
+ImportFormat_t importer_format_from_string(const char *name);
+
+/*
+ * Load the points from a CSV, NDJSON or GeoJSON FeatureCollection file.
+ *
+ * The file is mapped in memory, split at record boundaries and every chunk
+ * is parsed by its own thread. CSV columns are id, lat, lng, disappeared, desc, time
+ * unless the first line is a header naming them, a quoted field may hold
+ * newlines. JSON records use the same keys,
+ * GeoJSON features take their position from a Point geometry. The time is a
+ * UNIX timestamp.
+ *
+ * @param filename: The file to load
+ * @param format: The file format, IMPORT_FORMAT_AUTO to guess it
+ * @param threads: The number of parsing threads, 0 for one per CPU
+ * @return The array of Point_t
+ */
+PointArray_t *importer_load(const char *filename, ImportFormat_t format, int threads);
+
+#endif
@@ -30,89 +30,242 @@
  */
 
 #include "json_convertion.h"
+#include "json_writer.h"
 #include "cluster.h"
 #include "convert.h"
 #include "log.h"
 
-#include <jansson.h>
+#include <stdlib.h>
 
-static json_t *_create_array(Cluster_t *root, Cluster_t ***cluster);
+static void _write_array(JsonWriter_t *writer, Cluster_t *root, Cluster_t ***cluster);
 
-static json_t *_create_object_from_point(Cluster_t *point);
+static void _write_object_from_point(JsonWriter_t *writer, Cluster_t *cluster);
 
+static void _write_columns(JsonWriter_t *writer, Cluster_t *root, Cluster_t ***cluster, const Shift_t *shift);
 
-char *convert_from_cluster(Cluster_t *cluster) {
-    char *result = NULL;
-    json_t *root = json_object();
-    json_t *exists_array = _create_array(cluster, cluster->groups_exists);
-    json_t *disappeared_array = _create_array(cluster,
-                                              cluster->groups_disappeared);
 
-    json_object_set(root, "uncleaned", disappeared_array);
-    json_object_set(root, "cleaned", exists_array);
+void convert_from_cluster(Cluster_t *cluster, struct evbuffer *output, int precision) {
+    JsonWriter_t writer;
 
-    result = json_dumps(root, 0);
+    json_writer_init(&writer, output, precision);
 
-    json_decref(disappeared_array);
-    json_decref(exists_array);
-    json_decref(root);
+    JSON_WRITE_LITERAL(&writer, "{\"uncleaned\":");
+    _write_array(&writer, cluster, cluster->groups_disappeared);
+    JSON_WRITE_LITERAL(&writer, ",\"cleaned\":");
+    _write_array(&writer, cluster, cluster->groups_exists);
+    JSON_WRITE_LITERAL(&writer, "}");
 
-    return result;
+    json_writer_finish(&writer);
 }
 
-static json_t *_create_array(Cluster_t *root, Cluster_t ***cluster) {
-    json_t *array = json_array();
+void convert_from_cluster_sparse(Cluster_t *cluster, struct evbuffer *output, int precision) {
+    JsonWriter_t writer;
+
+    json_writer_init(&writer, output, precision);
+
+    JSON_WRITE_LITERAL(&writer, "{\"width\":");
+    json_writer_integer(&writer, cluster->width);
+    JSON_WRITE_LITERAL(&writer, ",\"height\":");
+    json_writer_integer(&writer, cluster->height);
+    JSON_WRITE_LITERAL(&writer, ",\"uncleaned\":");
+    _write_columns(&writer, cluster, cluster->groups_disappeared, NULL);
+    JSON_WRITE_LITERAL(&writer, ",\"cleaned\":");
+    _write_columns(&writer, cluster, cluster->groups_exists, NULL);
+    JSON_WRITE_LITERAL(&writer, "}");
+
+    json_writer_finish(&writer);
+}
+
+void convert_from_cluster_delta(Cluster_t *cluster, const Shift_t *shift, struct evbuffer *output, int precision) {
+    JsonWriter_t writer;
+    int first = 1;
+
+    json_writer_init(&writer, output, precision);
+
+    JSON_WRITE_LITERAL(&writer, "{\"delta\":true,\"rows\":");
+    json_writer_integer(&writer, shift->rows);
+    JSON_WRITE_LITERAL(&writer, ",\"columns\":");
+    json_writer_integer(&writer, shift->columns);
+    JSON_WRITE_LITERAL(&writer, ",\"width\":");
+    json_writer_integer(&writer, cluster->width);
+    JSON_WRITE_LITERAL(&writer, ",\"height\":");
+    json_writer_integer(&writer, cluster->height);
+
+    /* The previous cell (i, j) is the current (i - rows, j - columns) */
+    JSON_WRITE_LITERAL(&writer, ",\"left\":[");
+    for (int i = 0; i < cluster->height; i++) {
+        for (int j = 0; j < cluster->width; j++) {
+            Shift_t back = {-shift->rows, -shift->columns};
+
+            if (delta_was_visible(&back, cluster->width, cluster->height, i, j)) {
+                continue;
+            }
+
+            if (!first) {
+                JSON_WRITE_LITERAL(&writer, ",");
+            }
+            first = 0;
+            json_writer_integer(&writer, (int64_t) i * cluster->width + j);
+        }
+    }
+
+    JSON_WRITE_LITERAL(&writer, "],\"uncleaned\":");
+    _write_columns(&writer, cluster, cluster->groups_disappeared, shift);
+    JSON_WRITE_LITERAL(&writer, ",\"cleaned\":");
+    _write_columns(&writer, cluster, cluster->groups_exists, shift);
+    JSON_WRITE_LITERAL(&writer, "}");
+
+    json_writer_finish(&writer);
+}
+
+void convert_from_regions(const RegionSet_t *set, const RegionCount_t *counts, struct evbuffer *output,
+                          int precision) {
+    JsonWriter_t writer;
+    int first = 1;
+
+    json_writer_init(&writer, output, precision);
+    JSON_WRITE_LITERAL(&writer, "{\"regions\":[");
+
+    for (size_t i = 0; i < set->length; i++) {
+        if (!counts[i].count) {
+            continue;
+        }
+
+        if (!first) {
+            JSON_WRITE_LITERAL(&writer, ",");
+        }
+        JSON_WRITE_LITERAL(&writer, "{\"id\":");
+        first = 0;
+
+        if (set->regions[i].id && json_writer_valid_utf8(set->regions[i].id)) {
+            json_writer_string(&writer, set->regions[i].id);
+        } else {
+            json_writer_integer(&writer, (int64_t) i + 1);
+        }
+
+        if (set->regions[i].name && json_writer_valid_utf8(set->regions[i].name)) {
+            JSON_WRITE_LITERAL(&writer, ",\"name\":");
+            json_writer_string(&writer, set->regions[i].name);
+        }
+
+        JSON_WRITE_LITERAL(&writer, ",\"count\":");
+        json_writer_integer(&writer, counts[i].count);
+        JSON_WRITE_LITERAL(&writer, ",\"disappeared\":");
+        json_writer_integer(&writer, counts[i].disappeared);
+        JSON_WRITE_LITERAL(&writer, ",\"lat\":");
+        json_writer_double(&writer, counts[i].lat);
+        JSON_WRITE_LITERAL(&writer, ",\"lng\":");
+        json_writer_double(&writer, counts[i].lng);
+        JSON_WRITE_LITERAL(&writer, "}");
+    }
+
+    JSON_WRITE_LITERAL(&writer, "]}");
+    json_writer_finish(&writer);
+}
+
+static void _write_array(JsonWriter_t *writer, Cluster_t *root, Cluster_t ***cluster) {
+    JSON_WRITE_LITERAL(writer, "[");
 
     for (register int i = 0; i < root->height; i++) {
-        json_t *rows = json_array();
+        if (i) {
+            JSON_WRITE_LITERAL(writer, ",");
+        }
+        JSON_WRITE_LITERAL(writer, "[");
         for (register int j = 0; j < root->width; j++) {
-            json_t *point = _create_object_from_point(cluster[i][j]);
-            json_array_append(rows, point);
-            json_decref(point);
+            if (j) {
+                JSON_WRITE_LITERAL(writer, ",");
+            }
+            _write_object_from_point(writer, cluster[i][j]);
         }
-
-        json_array_append(array, rows);
-        json_decref(rows);
+        JSON_WRITE_LITERAL(writer, "]");
     }
 
-    return array;
+    JSON_WRITE_LITERAL(writer, "]");
 }
 
-static json_t *_create_object_from_point(Cluster_t *cluster) {
-    json_t *obj, *count, *lat, *lng, *desc, *pk;
+static void _write_object_from_point(JsonWriter_t *writer, Cluster_t *cluster) {
+    double lat, lng;
 
     if (!cluster->points_array->length) {
-        return json_null();
+        JSON_WRITE_LITERAL(writer, "null");
+        return;
     }
 
-    obj = json_object();
-    count = json_integer(cluster->points_array->length);
+    JSON_WRITE_LITERAL(writer, "{");
     if (cluster->points_array->length == 1) {
-        lat = json_real(convert_lat_to_gps(
-                cluster->points_array->points[0]->position.lat));
-        lng = json_real(convert_lng_to_gps(
-                cluster->points_array->points[0]->position.lng));
-
-        desc = json_string(cluster->points_array->points[0]->desc);
-        json_object_set(obj, "desc", desc);
-        json_decref(desc);
-
-        pk = json_integer(cluster->points_array->points[0]->pk);
-        json_object_set(obj, "id", pk);
-        json_decref(pk);
+        Point_t *point = cluster->points_array->points[0];
+
+        lat = convert_lat_to_gps(point->position.lat);
+        lng = convert_lng_to_gps(point->position.lng);
+
+        if (point->desc && json_writer_valid_utf8(point->desc)) {
+            JSON_WRITE_LITERAL(writer, "\"desc\":");
+            json_writer_string(writer, point->desc);
+            JSON_WRITE_LITERAL(writer, ",");
+        }
+
+        JSON_WRITE_LITERAL(writer, "\"id\":");
+        json_writer_integer(writer, point->pk);
+        JSON_WRITE_LITERAL(writer, ",");
     } else {
         cluster_compute_barycenter(cluster);
-        lat = json_real(convert_lat_to_gps(cluster->lat));
-        lng = json_real(convert_lng_to_gps(cluster->lng));
+        lat = convert_lat_to_gps(cluster->lat);
+        lng = convert_lng_to_gps(cluster->lng);
     }
 
-    json_object_set(obj, "count", count);
-    json_object_set(obj, "lat", lat);
-    json_object_set(obj, "lng", lng);
+    JSON_WRITE_LITERAL(writer, "\"count\":");
+    json_writer_integer(writer, (int64_t) cluster->points_array->length);
+    JSON_WRITE_LITERAL(writer, ",\"lat\":");
+    json_writer_double(writer, lat);
+    JSON_WRITE_LITERAL(writer, ",\"lng\":");
+    json_writer_double(writer, lng);
+    JSON_WRITE_LITERAL(writer, "}");
+}
 
-    json_decref(count);
-    json_decref(lat);
-    json_decref(lng);
+static void _write_separator(JsonWriter_t *writer, size_t k) {
+    if (k) {
+        JSON_WRITE_LITERAL(writer, ",");
+    }
+}
+
+/*
+ * Write the non empty cells column by column, only the ones the client
+ * doesn't have yet with a shift
+ */
+static void _write_columns(JsonWriter_t *writer, Cluster_t *root, Cluster_t ***cluster, const Shift_t *shift) {
+    size_t count;
+    ClusterCell_t *cells = cluster_collect_cells(root, cluster, shift, &count);
+
+    JSON_WRITE_LITERAL(writer, "{\"cell\":[");
+    for (size_t k = 0; k < count; k++) {
+        _write_separator(writer, k);
+        json_writer_integer(writer, cells[k].index);
+    }
+    JSON_WRITE_LITERAL(writer, "],\"count\":[");
+    for (size_t k = 0; k < count; k++) {
+        _write_separator(writer, k);
+        json_writer_integer(writer, cells[k].count);
+    }
+    JSON_WRITE_LITERAL(writer, "],\"lat\":[");
+    for (size_t k = 0; k < count; k++) {
+        _write_separator(writer, k);
+        json_writer_double(writer, cells[k].lat);
+    }
+    JSON_WRITE_LITERAL(writer, "],\"lng\":[");
+    for (size_t k = 0; k < count; k++) {
+        _write_separator(writer, k);
+        json_writer_double(writer, cells[k].lng);
+    }
+    JSON_WRITE_LITERAL(writer, "],\"id\":[");
+    for (size_t k = 0; k < count; k++) {
+        _write_separator(writer, k);
+        if (cells[k].point) {
+            json_writer_integer(writer, cells[k].point->pk);
+        } else {
+            JSON_WRITE_LITERAL(writer, "null");
+        }
+    }
+    JSON_WRITE_LITERAL(writer, "]}");
 
-    return obj;
-}
\ No newline at end of file
+    free(cells);
+}
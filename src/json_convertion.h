@@ -33,10 +33,55 @@
 #define __JSON_CONVERTION_H__
 
 #include "cluster.h"
+#include "delta.h"
+#include "region.h"
+
+#include <event2/buffer.h>
+
+/*
+ * Write the result of the computation as JSON at the end of the buffer
+ *
+ * @param cluster: The computed cluster
+ * @param output: The buffer to append to
+ * @param precision: The decimals of the coordinates, or NUMBER_SHORTEST
+ */
+void convert_from_cluster(Cluster_t * cluster, struct evbuffer * output, int precision);
+
+/*
+ * Write the result of the computation as JSON columns, only for the non empty
+ * cells: {"width":W,"height":H,"uncleaned":{"cell":[],"count":[],"lat":[],"lng":[],"id":[]},"cleaned":{...}}
+ * The cell is row * width + column, the id is null for the groups of points.
+ *
+ * @param cluster: The computed cluster
+ * @param output: The buffer to append to
+ * @param precision: The decimals of the coordinates, or NUMBER_SHORTEST
+ */
+void convert_from_cluster_sparse(Cluster_t * cluster, struct evbuffer * output, int precision);
 
 /*
- * Convert the result of the computation to a jansson structure
+ * Write the difference with a previous aligned viewport as JSON at the end of the buffer:
+ * {"delta":true,"rows":R,"columns":C,"width":W,"height":H,"left":[],"uncleaned":{...},"cleaned":{...}}
+ * The client moves its cells by the shift: its cell (i + R, j + C) becomes (i, j).
+ * "left" lists its cells that went out of the viewport, the columns hold the
+ * non empty cells that came in, like the sparse format. The cells seen by both
+ * viewports cover the same area of the same points, so they never change.
+ *
+ * @param cluster: The computed cluster
+ * @param shift: The move from the previous grid
+ * @param output: The buffer to append to
+ * @param precision: The decimals of the coordinates, or NUMBER_SHORTEST
+ */
+void convert_from_cluster_delta(Cluster_t * cluster, const Shift_t * shift, struct evbuffer * output, int precision);
+
+/*
+ * Write the non empty region counts as JSON at the end of the buffer
+ *
+ * @param set: The regions
+ * @param counts: The count of each region
+ * @param output: The buffer to append to
+ * @param precision: The decimals of the barycenters, or NUMBER_SHORTEST
  */
-char * convert_from_cluster(Cluster_t * cluster);
+void convert_from_regions(const RegionSet_t * set, const RegionCount_t * counts, struct evbuffer * output,
+                          int precision);
 
 #endif
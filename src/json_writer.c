@@ -0,0 +1,187 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "json_writer.h"
+#include "number.h"
+
+#include <math.h>
+#include <string.h>
+
+void json_writer_init(JsonWriter_t *writer, struct evbuffer *output, int precision)
+{
+    buffer_writer_init(&writer->buffer, output);
+    writer->precision = precision;
+}
+
+void json_writer_finish(JsonWriter_t *writer)
+{
+    buffer_writer_commit(&writer->buffer);
+}
+
+size_t json_writer_length(const JsonWriter_t *writer)
+{
+    return buffer_writer_length(&writer->buffer);
+}
+
+void json_writer_raw(JsonWriter_t *writer, const char *text, size_t length)
+{
+    buffer_writer_reserve(&writer->buffer, length);
+    memcpy(writer->buffer.cursor, text, length);
+    writer->buffer.cursor += length;
+}
+
+void json_writer_string(JsonWriter_t *writer, const char *value)
+{
+    static const char Hex[] = "0123456789abcdef";
+    size_t length = strlen(value);
+    char *o;
+
+    /* Worst case: every byte becomes \u00XX */
+    buffer_writer_reserve(&writer->buffer, length * 6 + 2);
+    o = writer->buffer.cursor;
+
+    *o++ = '"';
+    for (const unsigned char *p = (const unsigned char *) value; *p; p++)
+    {
+        switch (*p)
+        {
+            case '"': *o++ = '\\'; *o++ = '"'; break;
+            case '\\': *o++ = '\\'; *o++ = '\\'; break;
+            case '\b': *o++ = '\\'; *o++ = 'b'; break;
+            case '\f': *o++ = '\\'; *o++ = 'f'; break;
+            case '\n': *o++ = '\\'; *o++ = 'n'; break;
+            case '\r': *o++ = '\\'; *o++ = 'r'; break;
+            case '\t': *o++ = '\\'; *o++ = 't'; break;
+            default:
+                if (*p < 0x20)
+                {
+                    memcpy(o, "\\u00", 4);
+                    o[4] = Hex[*p >> 4];
+                    o[5] = Hex[*p & 0xF];
+                    o += 6;
+                }
+                else
+                {
+                    *o++ = (char) *p;
+                }
+        }
+    }
+    *o++ = '"';
+
+    writer->buffer.cursor = o;
+}
+
+void json_writer_integer(JsonWriter_t *writer, int64_t value)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? (uint64_t) 0 - (uint64_t) value : (uint64_t) value;
+
+    do
+    {
+        *--p = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+
+    json_writer_raw(writer, p, (size_t) (digits + sizeof(digits) - p));
+}
+
+void json_writer_double(JsonWriter_t *writer, double value)
+{
+    if (!isfinite(value))
+    {
+        JSON_WRITE_LITERAL(writer, "null");
+        return;
+    }
+
+    buffer_writer_reserve(&writer->buffer, NUMBER_FORMAT_MAX);
+    writer->buffer.cursor += number_format_double(writer->buffer.cursor, value, writer->precision);
+}
+
+int json_writer_valid_utf8(const char *value)
+{
+    /* The smallest code of each length, a smaller one is an overlong form */
+    static const uint32_t Minimum[] = {0, 0x80, 0x800, 0x10000};
+    const unsigned char *p = (const unsigned char *) value;
+
+    while (*p)
+    {
+        int follow, length;
+        uint32_t code;
+
+        if (*p < 0x80)
+        {
+            p++;
+            continue;
+        }
+        else if ((*p & 0xE0) == 0xC0)
+        {
+            follow = 1;
+            code = *p & 0x1F;
+        }
+        else if ((*p & 0xF0) == 0xE0)
+        {
+            follow = 2;
+            code = *p & 0x0F;
+        }
+        else if ((*p & 0xF8) == 0xF0)
+        {
+            follow = 3;
+            code = *p & 0x07;
+        }
+        else
+        {
+            return 0;
+        }
+
+        for (length = follow, p++; follow; follow--, p++)
+        {
+            if ((*p & 0xC0) != 0x80)
+            {
+                return 0;
+            }
+            code = (code << 6) | (*p & 0x3F);
+        }
+
+        /* Overlong forms, beyond Unicode, and the UTF-16 surrogates */
+        if (code < Minimum[length] || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include "buffer_writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Write JSON text straight into the free space of an evbuffer, without
+ * building a DOM nor an intermediate string.
+ */
+typedef struct JsonWriter_t
+{
+    BufferWriter_t buffer;
+    int precision;
+} JsonWriter_t;
+
+/*
+ * Start writing at the end of the output buffer
+ *
+ * @param writer: The writer to initialize
+ * @param output: The buffer to append to
+ * @param precision: The decimals of the real numbers, or NUMBER_SHORTEST
+ */
+void json_writer_init(JsonWriter_t *writer, struct evbuffer *output, int precision);
+
+/*
+ * Commit the written bytes to the output buffer. The writer can't be used anymore.
+ */
+void json_writer_finish(JsonWriter_t *writer);
+
+/*
+ * Get the length of the output buffer, with the bytes not committed yet
+ */
+size_t json_writer_length(const JsonWriter_t *writer);
+
+/*
+ * Write some text as is (punctuation, keys known to need no escaping...)
+ */
+void json_writer_raw(JsonWriter_t *writer, const char *text, size_t length);
+
+/*
+ * Write a quoted and escaped string. The string must be valid UTF-8.
+ */
+void json_writer_string(JsonWriter_t *writer, const char *value);
+
+/*
+ * Write an integer
+ */
+void json_writer_integer(JsonWriter_t *writer, int64_t value);
+
+/*
+ * Write a real number with the writer precision, null if it's not finite
+ */
+void json_writer_double(JsonWriter_t *writer, double value);
+
+/*
+ * Check a string is valid UTF-8 (jansson used to drop the invalid ones)
+ */
+int json_writer_valid_utf8(const char *value);
+
+#define JSON_WRITE_LITERAL(writer, text) json_writer_raw(writer, text, sizeof(text) - 1)
+
+#endif
@@ -66,11 +66,11 @@ void log_init(FILE *file, MessageType level)
 static void now(char *date)
 {
     time_t rawtime;
-    struct tm *timeinfo;
+    struct tm timeinfo;
 
     time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(date, MAX_DATE_SIZE, "%x %X", timeinfo);
+    localtime_r(&rawtime, &timeinfo);
+    strftime(date, MAX_DATE_SIZE, "%x %X", &timeinfo);
 }
 
 static void _log(MessageType type, const char *message, va_list args)
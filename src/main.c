@@ -33,188 +33,1481 @@
 #include "file.h"
 #include "cluster.h"
 #include "json_convertion.h"
+#include "msgpack_convertion.h"
+#include "mvt_convertion.h"
+#include "compression.h"
+#include "response_cache.h"
+#include "compute_pool.h"
+#include "flight.h"
+#include "prefork.h"
+#include "affinity.h"
+#include "export.h"
+#include "delta.h"
 #include "config.h"
 #include "server.h"
 #include "database.h"
+#include "importer.h"
+#include "shared_store.h"
+#include "region.h"
+#include "number.h"
 #include "log.h"
 
 #include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <event2/buffer.h>
-#include <event2/keyvalq_struct.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
 #include <evhttp.h>
+#include <inttypes.h>
 #include <time.h>
 
 
 static uint8_t MaxSize = 100;
 
+#define QUERY_KEY_SIZE 512
+
+/* A weak ETag, W/"version-hash" */
+#define ETAG_SIZE 48
+
 typedef struct Application_t
 {
-    Configuration_t * config;
-    PointArray_t * points;
-} Application_t;
+    Configuration_t * config;
+    PointArray_t * points;
+    RegionSet_t * regions;
+    ResponseCache_t * cache;
+    ComputePool_t * pool;
+    FlightTable_t * flights;
+    size_t waiting;
+    uint64_t latency;
+    uint64_t version;
+    PointArray_t ** replicas;
+    int nodes;
+} Application_t;
+
+/*
+ * The parameters of a request
+ */
+typedef struct Query_t
+{
+    Bound_t bounds;
+    int clusterize;
+    int sparse;
+    int precision;
+    uint32_t since, until;
+    const char *binary_type;
+    const Tile_t *tile;
+    int has_previous;
+    Viewport_t previous;
+    const Shift_t *shift;
+    uint8_t max_size;
+} Query_t;
+
+/*
+ * Display the program usage
+ *
+ * @param args: The argument structure.
+ */
+static void usage_if_needed(Argument_t *args)
+{
+    if (args && args->help)
+    {
+        fprintf(stderr, "Usage: geocluster [OPTIONS]\n");
+        fprintf(stderr, "Options are:\n");
+        fprintf(stderr, "   -h|--help          : Display this message\n");
+        fprintf(stderr, "   -c|--config FILE   : The configuration file\n");
+        fprintf(stderr, "   -f|--file FILENAME : Load the points from a CSV, NDJSON or GeoJSON file instead of MySQL\n");
+        fprintf(stderr, "   -p|--publish       : Publish the points in the [shared] memory segment and exit\n");
+        fprintf(stderr, "   -w|--workers N     : Serve from N processes forked once the points are loaded\n");
+        fprintf(stderr, "\n");
+
+        exit(EXIT_SUCCESS);
+    }
+}
+
+/*
+ * The copy of the points on the NUMA node of the calling thread, or the
+ * points themselves
+ */
+static PointArray_t *local_points(Application_t *app)
+{
+    int node;
+
+    if (!app->replicas)
+    {
+        return app->points;
+    }
+
+    node = affinity_current_node();
+    return node < app->nodes && app->replicas[node] ? app->replicas[node] : app->points;
+}
+
+/*
+ * The cells of the grid of a query, the delta tokens carry them
+ *
+ * @param config: The configuration
+ * @param query: The request parameters
+ * @param width: Where to store the columns
+ * @param height: Where to store the rows
+ */
+static void grid_size(const Configuration_t *config, const Query_t *query, uint8_t *width, uint8_t *height)
+{
+    *width = query->clusterize == 0 ? MaxSize : config->width;
+    *height = query->clusterize == 0 ? MaxSize : config->width;
+
+    /* Coarser when the server is busy */
+    if (query->max_size)
+    {
+        *width = *width > query->max_size ? query->max_size : *width;
+        *height = *height > query->max_size ? query->max_size : *height;
+    }
+}
+
+/*
+ * Do the clustering  with the database result.
+ *
+ * @param points_array: The points, sorted by time
+ * @param config: The configuration
+ * @param query: The request parameters
+ * @param output: Where to write the JSON, MessagePack or vector tile result
+ * @param cancelled: Checked during the computation, or NULL
+ * @param data: The argument of cancelled
+ * @return 0 if cancelled, nothing is written
+ */
+static int process_clustering(PointArray_t *points_array, Configuration_t *config, const Query_t *query,
+                              struct evbuffer *output, ClusterCancel cancelled, void *data)
+{
+    Cluster_t *cluster = NULL;
+    PointArray_t view;
+    uint8_t width, height;
+
+    grid_size(config, query, &width, &height);
+
+    /* The points are sorted by time, only scan the requested period */
+    points_array_time_range(points_array, query->since, query->until, &view);
+
+    cluster = cluster_create(width, height, &view);
+    cluster_set_bounds(cluster, query->bounds.north, query->bounds.south, query->bounds.east, query->bounds.west);
+    cluster_set_cancel(cluster, cancelled, data);
+    if (!cluster_compute(cluster, query->clusterize))
+    {
+        cluster_dispose(cluster);
+        return 0;
+    }
+
+    if (query->tile)
+    {
+        convert_from_cluster_mvt(cluster, query->tile, output);
+    }
+    else if (query->shift)
+    {
+        convert_from_cluster_delta(cluster, query->shift, output, query->precision);
+    }
+    else if (query->binary_type)
+    {
+        convert_from_cluster_msgpack(cluster, output, query->sparse);
+    }
+    else if (query->sparse)
+    {
+        convert_from_cluster_sparse(cluster, output, query->precision);
+    }
+    else
+    {
+        convert_from_cluster(cluster, output, query->precision);
+    }
+    cluster_dispose(cluster);
+
+    return 1;
+}
+
+/*
+ * The longest key or value of the query string, a delta token fits
+ */
+#define QUERY_VALUE_MAX DELTA_TOKEN_SIZE
+
+typedef enum
+{
+    PARAMETER_UNKNOWN,
+    PARAMETER_NORTH,
+    PARAMETER_SOUTH,
+    PARAMETER_EAST,
+    PARAMETER_WEST,
+    PARAMETER_CLUSTER,
+    PARAMETER_SINCE,
+    PARAMETER_UNTIL,
+    PARAMETER_FORMAT,
+    PARAMETER_DELTA,
+    PARAMETER_PRECISION,
+} Parameter_t;
+
+/*
+ * Recognize a key by its length and first letter, one comparison at most
+ */
+static Parameter_t parameter_of(const char *key, size_t length)
+{
+    switch (length)
+    {
+        case 4:
+            return !memcmp(key, "east", 4) ? PARAMETER_EAST : !memcmp(key, "west", 4) ? PARAMETER_WEST
+                                                                                        : PARAMETER_UNKNOWN;
+        case 5:
+            switch (key[0])
+            {
+                case 'n':
+                    return !memcmp(key, "north", 5) ? PARAMETER_NORTH : PARAMETER_UNKNOWN;
+                case 's':
+                    return !memcmp(key, "south", 5) ? PARAMETER_SOUTH : !memcmp(key, "since", 5) ? PARAMETER_SINCE
+                                                                                                  : PARAMETER_UNKNOWN;
+                case 'u':
+                    return !memcmp(key, "until", 5) ? PARAMETER_UNTIL : PARAMETER_UNKNOWN;
+                case 'd':
+                    return !memcmp(key, "delta", 5) ? PARAMETER_DELTA : PARAMETER_UNKNOWN;
+                default:
+                    return PARAMETER_UNKNOWN;
+            }
+        case 6:
+            return !memcmp(key, "format", 6) ? PARAMETER_FORMAT : PARAMETER_UNKNOWN;
+        case 7:
+            return !memcmp(key, "cluster", 7) ? PARAMETER_CLUSTER : PARAMETER_UNKNOWN;
+        case 9:
+            return !memcmp(key, "precision", 9) ? PARAMETER_PRECISION : PARAMETER_UNKNOWN;
+        default:
+            return PARAMETER_UNKNOWN;
+    }
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    c = (char) (c | 0x20);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/*
+ * Decode a key or a value of the query string in a buffer of the stack
+ *
+ * @return The length, or -1 if it is too long or has a malformed escape
+ */
+static int decode_component(const char *begin, const char *end, char *buffer, size_t size)
+{
+    size_t length = 0;
+
+    for (const char *p = begin; p < end; p++)
+    {
+        char c = *p;
+
+        if (length + 1 >= size)
+        {
+            return -1;
+        }
+
+        if (c == '+')
+        {
+            c = ' ';
+        }
+        else if (c == '%')
+        {
+            int high = p + 2 < end ? hex_value(p[1]) : -1;
+            int low = high >= 0 ? hex_value(p[2]) : -1;
+
+            if (low < 0)
+            {
+                return -1;
+            }
+            c = (char) (high * 16 + low);
+            p += 2;
+        }
+        buffer[length++] = c;
+    }
+    buffer[length] = '\0';
+
+    return (int) length;
+}
+
+/*
+ * A whole value is a finite number, nothing before or after
+ */
+static int parse_coordinate(const char *value, int length, double *coordinate)
+{
+    return number_parse_double(value, value + length, coordinate) == value + length && isfinite(*coordinate);
+}
+
+/*
+ * Read the bounds, the cluster flag, the time range, the format, the precision
+ * and the previous viewport token from the query string. Reply with a 400 when they're invalid.
+ *
+ * The query string is read in place, nothing is allocated.
+ *
+ * @param exchange: The request
+ * @param config: The configuration, for the default precision
+ * @param query: Where to store the parameters
+ * @return 1 if the parameters are valid
+ */
+static int parse_parameters(ServerExchange_t *exchange, const Configuration_t *config, Query_t *query)
+{
+    Bound_t *bounds = &query->bounds;
+    int got_north = 0, got_west = 0, got_east = 0, got_south = 0;
+    const char *pair = exchange->query;
+
+    memset(query, 0, sizeof(Query_t));
+    query->clusterize = 1;
+    query->precision = config->output.precision;
+
+    log_debug("Got parameters: %s", exchange->uri);
+    while (pair && *pair)
+    {
+        const char *end = pair + strcspn(pair, "&");
+        const char *equal = memchr(pair, '=', (size_t) (end - pair));
+        char key[16], value[QUERY_VALUE_MAX];
+        int key_length, length;
+        const char *invalid = NULL;
+
+        if (end == pair)
+        {
+            pair++;
+            continue;
+        }
+
+        key_length = equal ? decode_component(pair, equal, key, sizeof(key)) : -1;
+        length = equal ? decode_component(equal + 1, end, value, sizeof(value)) : -1;
+        pair = *end ? end + 1 : end;
+        if (key_length < 0 || length < 0)
+        {
+            log_error("Malformed parameter in %s", exchange->uri);
+            server_send_reply(exchange, 400, "Bad Request", NULL);
+            return 0;
+        }
+
+        log_debug("Key: %s , Value: %s", key, value);
+
+        switch (parameter_of(key, (size_t) key_length))
+        {
+            case PARAMETER_NORTH:
+                got_north = parse_coordinate(value, length, &bounds->north);
+                invalid = got_north ? NULL : key;
+                break;
+
+            case PARAMETER_SOUTH:
+                got_south = parse_coordinate(value, length, &bounds->south);
+                invalid = got_south ? NULL : key;
+                break;
+
+            case PARAMETER_EAST:
+                got_east = parse_coordinate(value, length, &bounds->east);
+                invalid = got_east ? NULL : key;
+                break;
+
+            case PARAMETER_WEST:
+                got_west = parse_coordinate(value, length, &bounds->west);
+                invalid = got_west ? NULL : key;
+                break;
+
+            case PARAMETER_CLUSTER:
+                query->clusterize = !strcmp("false", value) ? 0 : 1;
+                break;
+
+            case PARAMETER_SINCE:
+                invalid = number_parse_uint32(value, value + length, &query->since) == value + length ? NULL : key;
+                break;
+
+            case PARAMETER_UNTIL:
+                invalid = number_parse_uint32(value, value + length, &query->until) == value + length ? NULL : key;
+                break;
+
+            case PARAMETER_FORMAT:
+                if (!strcmp("sparse", value))
+                {
+                    query->sparse = 1;
+                }
+                else if (strcmp("grid", value) != 0)
+                {
+                    log_error("Unknown format %s", value);
+                    server_send_reply(exchange, 400, "Bad Request: format is grid or sparse", NULL);
+                    return 0;
+                }
+                break;
+
+            case PARAMETER_DELTA:
+                if (!delta_token_read(value, &query->previous))
+                {
+                    log_error("Malformed delta token %s", value);
+                    server_send_reply(exchange, 400, "Bad Request: malformed delta token", NULL);
+                    return 0;
+                }
+                query->has_previous = 1;
+                break;
+
+            case PARAMETER_PRECISION:
+            {
+                uint32_t precision = 0;
+
+                if (!strcmp("shortest", value))
+                {
+                    query->precision = NUMBER_SHORTEST;
+                }
+                else if (number_parse_uint32(value, value + length, &precision) == value + length && precision <= 15)
+                {
+                    query->precision = (int) precision;
+                }
+                else
+                {
+                    log_error("Invalid precision %s", value);
+                    server_send_reply(exchange, 400, "Bad Request: precision is 0 to 15 or shortest", NULL);
+                    return 0;
+                }
+                break;
+            }
+
+            default:
+                log_error("Unknown key %s, with this value %s\n", key, value);
+                server_send_reply(exchange, 400, "Bad Request", NULL);
+                return 0;
+        }
+
+        if (invalid)
+        {
+            log_error("Invalid number %s for %s", value, invalid);
+            server_send_reply(exchange, 400, "Bad Request: malformed number", NULL);
+            return 0;
+        }
+    }
+
+    log_debug("Parameters are: north:%f south:%f east:%f west:%f",
+              bounds->north, bounds->south, bounds->east, bounds->west);
+
+    if (!(got_east && got_north && got_south && got_west))
+    {
+        log_error("Missing parameters");
+        server_send_reply(exchange, 400, "Bad Request: Missing parameters", NULL);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Find the MessagePack media type in the Accept header of the request.
+ *
+ * @param exchange: The request
+ * @return The accepted MessagePack type, NULL for JSON
+ */
+static const char *accepted_binary_type(ServerExchange_t *exchange)
+{
+    static const char *const Types[] = {"application/msgpack", "application/x-msgpack"};
+    const char *accept = server_find_header(exchange, "Accept");
+
+    while (accept && *accept)
+    {
+        size_t length;
+        const char *parameters;
+
+        accept += strspn(accept, " \t,");
+        length = strcspn(accept, ",; \t");
+        parameters = accept + length;
+
+        for (size_t i = 0; i < sizeof(Types) / sizeof(Types[0]); i++)
+        {
+            if (length == strlen(Types[i]) && !strncasecmp(accept, Types[i], length))
+            {
+                /* q=0 means not acceptable */
+                const char *q = strstr(parameters, "q=");
+                const char *next = strchr(parameters, ',');
+
+                if (!q || (next && q > next) || strtod(q + 2, NULL) > 0.)
+                {
+                    return Types[i];
+                }
+            }
+        }
+
+        accept = strchr(parameters, ',');
+    }
+
+    return NULL;
+}
+
+/*
+ * Write the normalized parameters of a query, the cache key of its response.
+ *
+ * @param route: The path of the request
+ * @param query: The request parameters
+ * @param key: Where to write the key
+ * @param size: The size of the key buffer
+ */
+static void query_key(const char *route, const Query_t *query, char *key, size_t size)
+{
+    int length;
+
+    if (query->tile)
+    {
+        snprintf(key, size, "tile %u/%u/%u %u", query->tile->z, query->tile->x, query->tile->y, query->max_size);
+        return;
+    }
+
+    length = snprintf(key, size, "%s %.17g %.17g %.17g %.17g %d %d %d %u %u %s %u", route,
+                      query->bounds.north, query->bounds.south, query->bounds.east, query->bounds.west,
+                      query->clusterize, query->sparse, query->precision, query->since, query->until,
+                      query->binary_type ? query->binary_type : "json", query->max_size);
+
+    /* A delta body depends on the previous viewport, a full body doesn't */
+    if (query->shift && length > 0 && (size_t) length + DELTA_TOKEN_SIZE + 7 <= size)
+    {
+        memcpy(key + length, " delta ", 7);
+        delta_token_write(&query->previous, key + length + 7);
+    }
+}
+
+/*
+ * Check the If-None-Match header against an entity tag
+ */
+static int etag_matches(const char *if_none_match, const char *etag)
+{
+    /* The comparison is weak, W/ is ignored on both sides */
+    const char *opaque = etag + 2;
+    size_t length = strlen(opaque);
+
+    while (if_none_match && *if_none_match)
+    {
+        if_none_match += strspn(if_none_match, " \t,");
+        if (*if_none_match == '*')
+        {
+            return 1;
+        }
+        if (!strncmp(if_none_match, "W/", 2))
+        {
+            if_none_match += 2;
+        }
+        if (!strncmp(if_none_match, opaque, length))
+        {
+            return 1;
+        }
+        if_none_match = strchr(if_none_match, ',');
+    }
+
+    return 0;
+}
+
+/*
+ * Tag the response with the dataset version and the normalized query, and
+ * answer 304 Not Modified when the client already has it.
+ *
+ * @param exchange: The request
+ * @param app: The application, for the version and the Cache-Control policy
+ * @param key: The normalized query
+ * @param vary: The Vary header value
+ * @return 1 if the 304 was sent
+ */
+static int not_modified(ServerExchange_t *exchange, Application_t *app, const char *key, const char *vary)
+{
+    char etag[ETAG_SIZE];
+
+    /* Weak, the gzip and identity bodies are the same representation */
+    snprintf(etag, sizeof(etag), "W/\"%" PRIx64 "-%" PRIx64 "\"", app->version, response_cache_hash(key));
+    server_add_header(exchange, "ETag", etag);
+    if (app->config->cache.control)
+    {
+        server_add_header(exchange, "Cache-Control", app->config->cache.control);
+    }
+
+    if (!etag_matches(server_find_header(exchange, "If-None-Match"), etag))
+    {
+        return 0;
+    }
+
+    log_debug("Not modified: %s", key);
+    server_add_header(exchange, "Vary", vary);
+    server_send_reply(exchange, 304, "Not Modified", NULL);
+    return 1;
+}
+
+/*
+ * Choose the encoding of a response from the Accept-Encoding header.
+ *
+ * @param exchange: The request
+ * @param config: The configuration, for the compression
+ * @param length: The length of the uncompressed body
+ * @return The encoding
+ */
+static Encoding_t choose_encoding(ServerExchange_t *exchange, Configuration_t *config, size_t length)
+{
+    if (config->compression.level <= 0 || length < config->compression.min_size)
+    {
+        return ENCODING_IDENTITY;
+    }
+
+    return compression_negotiate(server_find_header(exchange, "Accept-Encoding"));
+}
+
+/*
+ * Send a body with its headers and release the buffer.
+ */
+static void send_reply(ServerExchange_t *exchange, struct evbuffer *buf, const char *content_type,
+                       const char *vary, Encoding_t encoding)
+{
+    server_add_header(exchange, "Content-Type", content_type);
+    server_add_header(exchange, "Vary", vary);
+    if (encoding != ENCODING_IDENTITY)
+    {
+        server_add_header(exchange, "Content-Encoding", compression_content_encoding(encoding));
+    }
+
+    server_send_reply(exchange, 200, "OK", buf);
+    evbuffer_free(buf);
+}
+
+/*
+ * Send a cached response in the best encoding the client accepts. The
+ * compressed body is computed the first time, then kept in the entry. The
+ * body is attached by reference, never copied.
+ *
+ * The shard of the key is locked by the caller and unlocked here, as soon
+ * as the body is retained. It is not locked during the compression, the
+ * entry is looked up again to keep its compressed body.
+ *
+ * @param exchange: The request
+ * @param cache: The cache of the entry
+ * @param config: The configuration, for the compression
+ * @param key: The key of the entry
+ * @param entry: The response, with its identity body
+ * @param vary: The Vary header value
+ */
+static void send_entry(ServerExchange_t *exchange, ResponseCache_t *cache, Configuration_t *config,
+                       const char *key, CacheEntry_t *entry, const char *vary)
+{
+    Body_t *identity = entry->bodies[ENCODING_IDENTITY];
+    Encoding_t encoding = choose_encoding(exchange, config, identity->length);
+    const char *content_type = entry->content_type;
+    struct evbuffer *buf = evbuffer_new();
+    struct evbuffer *content = NULL;
+    struct evbuffer *compressed = NULL;
+    Body_t *body = NULL;
+
+    if (entry->bodies[encoding])
+    {
+        body = body_retain(entry->bodies[encoding]);
+        response_cache_unlock(cache, key);
+        body_add_to(body, buf);
+        body_release(body);
+        send_reply(exchange, buf, content_type, vary, encoding);
+        return;
+    }
+
+    body_retain(identity);
+    response_cache_unlock(cache, key);
+
+    content = evbuffer_new();
+    compressed = evbuffer_new();
+    body_copy_to(identity, content);
+    body_release(identity);
+    compression_compress(content, encoding, config->compression.level, compressed);
+    log_debug("Compressed %zu bytes to %zu with %s", evbuffer_get_length(content), evbuffer_get_length(compressed),
+              compression_content_encoding(encoding));
+
+    response_cache_lock(cache, key);
+    entry = response_cache_find(cache, key);
+    if (entry && !entry->bodies[encoding])
+    {
+        response_cache_set_body(cache, entry, encoding, compressed);
+    }
+    body = entry ? body_retain(entry->bodies[encoding]) : NULL;
+    response_cache_unlock(cache, key);
+
+    if (body)
+    {
+        body_add_to(body, buf);
+        body_release(body);
+    }
+    else
+    {
+        evbuffer_add_buffer(buf, compressed);
+    }
+
+    evbuffer_free(compressed);
+    evbuffer_free(content);
+    send_reply(exchange, buf, content_type, vary, encoding);
+}
+
+/*
+ * Send a body computed for this request only, compressed if the client accepts it.
+ *
+ * @param exchange: The request
+ * @param config: The configuration, for the compression
+ * @param buf: The body, released
+ * @param content_type: The Content-Type header value
+ * @param vary: The Vary header value
+ */
+static void send_body(ServerExchange_t *exchange, Configuration_t *config, struct evbuffer *buf,
+                      const char *content_type, const char *vary)
+{
+    Encoding_t encoding = choose_encoding(exchange, config, evbuffer_get_length(buf));
+
+    if (encoding != ENCODING_IDENTITY)
+    {
+        struct evbuffer *compressed = evbuffer_new();
+
+        compression_compress(buf, encoding, config->compression.level, compressed);
+        evbuffer_free(buf);
+        buf = compressed;
+    }
+
+    send_reply(exchange, buf, content_type, vary, encoding);
+}
+
+/*
+ * A request waiting for a clustering, alone or with the identical ones
+ */
+typedef struct
+{
+    struct evhttp_request *req;
+    struct evhttp_connection *connection;
+    Application_t *app;
+    char key[QUERY_KEY_SIZE];
+    const char *content_type;
+    const char *vary;
+    int cacheable;
+    int gone;
+    struct event *watch;
+    Flight_t *flight;
+} ClusterWaiter_t;
+
+/*
+ * A clustering computed in the compute pool, its requests wait in their loops
+ */
+typedef struct
+{
+    Application_t *app;
+    Flight_t *flight;
+    Query_t query;
+    Tile_t tile;
+    Shift_t shift;
+    const char *key;
+    const char *content_type;
+    int cacheable;
+    struct timespec submitted;
+    struct timespec deadline;
+    int cancelled;
+    struct evbuffer *output;
+    double milliseconds;
+} ClusterJob_t;
+
+/*
+ * Reject a request, the server is too busy for it
+ */
+static void send_overloaded(ServerExchange_t *exchange, const Configuration_t *config)
+{
+    char retry_after[16];
+
+    snprintf(retry_after, sizeof(retry_after), "%u", config->compute.retry_after);
+    server_add_header(exchange, "Retry-After", retry_after);
+    server_send_reply(exchange, 503, "Service Unavailable", NULL);
+}
+
+/*
+ * Average the time from the request to the end of its computation
+ */
+static void record_latency(Application_t *app, const struct timespec *submitted)
+{
+    struct timespec now;
+    uint64_t sample, average;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sample = (uint64_t) (now.tv_sec - submitted->tv_sec) * 1000000 +
+             (uint64_t) ((now.tv_nsec - submitted->tv_nsec) / 1000);
+
+    /* The last one weights 1/8, as the smoothed round trip time of TCP */
+    average = __atomic_load_n(&app->latency, __ATOMIC_RELAXED);
+    __atomic_store_n(&app->latency, average - average / 8 + sample / 8, __ATOMIC_RELAXED);
+}
+
+/*
+ * Limit the grid of a query when the computations pile up or get slow, and
+ * tell it to the client. Full quality comes back with the load going down.
+ *
+ * @param exchange: The request
+ * @param app: The application
+ * @param query: The request parameters
+ */
+static void degrade_if_busy(ServerExchange_t *exchange, Application_t *app, Query_t *query)
+{
+    DegradationConfig_t *degradation = &app->config->degradation;
+    uint64_t latency = __atomic_load_n(&app->latency, __ATOMIC_RELAXED);
+    char value[16];
+
+    if ((degradation->queue && compute_pool_pending(app->pool) > degradation->queue) ||
+        (degradation->latency && latency > (uint64_t) degradation->latency * 1000))
+    {
+        query->max_size = degradation->size;
+        snprintf(value, sizeof(value), "grid=%u", degradation->size);
+        server_add_header(exchange, "X-Degraded", value);
+        log_debug("Busy, the grid is %u wide at most", degradation->size);
+    }
+}
+
+/*
+ * Send a shared body, compressed for this client if it accepts it
+ */
+static void send_shared_body(ServerExchange_t *exchange, Configuration_t *config, Body_t *body,
+                             const char *content_type, const char *vary)
+{
+    struct evbuffer *buf = evbuffer_new();
+
+    if (choose_encoding(exchange, config, body->length) == ENCODING_IDENTITY)
+    {
+        body_add_to(body, buf);
+        send_reply(exchange, buf, content_type, vary, ENCODING_IDENTITY);
+        return;
+    }
+
+    body_copy_to(body, buf);
+    send_body(exchange, config, buf, content_type, vary);
+}
+
+/*
+ * The client left, the computation may be abandoned if it was the last
+ */
+static void waiter_gone(ClusterWaiter_t *waiter)
+{
+    if (!waiter->gone)
+    {
+        waiter->gone = 1;
+        flight_leave(waiter->app->flights, waiter->flight);
+    }
+}
+
+/*
+ * The client left, its waiter only has to be freed
+ */
+static void on_waiter_connection_close(struct evhttp_connection *connection, void *arg)
+{
+    ClusterWaiter_t *waiter = (ClusterWaiter_t *) arg;
+
+    /* The request is freed by libevent, and the socket with it */
+    event_del(waiter->watch);
+    waiter->req = NULL;
+    waiter_gone(waiter);
+    evhttp_connection_set_closecb(connection, NULL, NULL);
+}
+
+/*
+ * libevent does not read the connection while the request is processed, a
+ * reset is seen here. The reply is still sent, and fails.
+ */
+static void on_waiter_readable(evutil_socket_t fd, short what, void *arg)
+{
+    ClusterWaiter_t *waiter = (ClusterWaiter_t *) arg;
+    char byte;
+    ssize_t got = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    (void) what;
+
+    /*
+     * A pipelined request is left to libevent. The end of the stream may be a
+     * half-close of a client still reading: the watch stops there, and the
+     * close callback tells when the client is really gone.
+     */
+    if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        waiter_gone(waiter);
+    }
+    else if (got < 0)
+    {
+        event_add(waiter->watch, NULL);
+    }
+}
+
+static void waiter_dispose(ClusterWaiter_t *waiter)
+{
+    event_free(waiter->watch);
+    __atomic_sub_fetch(&waiter->app->waiting, 1, __ATOMIC_RELAXED);
+    free(waiter);
+}
+
+/*
+ * In the loop of the request, the clustering is done
+ */
+static void on_clustering_landed(Body_t *body, void *data)
+{
+    ClusterWaiter_t *waiter = (ClusterWaiter_t *) data;
+    Application_t *app = waiter->app;
+    CacheEntry_t *entry = NULL;
+    ServerExchange_t exchange;
+
+    if (!waiter->req)
+    {
+        waiter_dispose(waiter);
+        return;
+    }
+    evhttp_connection_set_closecb(waiter->connection, NULL, NULL);
+    server_exchange_from_request(&exchange, waiter->req);
+
+    if (!body)
+    {
+        send_overloaded(&exchange, app->config);
+        waiter_dispose(waiter);
+        return;
+    }
+
+    /* From the cache entry, to share its compressed bodies too */
+    response_cache_lock(app->cache, waiter->key);
+    entry = waiter->cacheable ? response_cache_find(app->cache, waiter->key) : NULL;
+    if (entry && entry->bodies[ENCODING_IDENTITY] == body)
+    {
+        send_entry(&exchange, app->cache, app->config, waiter->key, entry, waiter->vary);
+    }
+    else
+    {
+        response_cache_unlock(app->cache, waiter->key);
+        send_shared_body(&exchange, app->config, body, waiter->content_type, waiter->vary);
+    }
+
+    waiter_dispose(waiter);
+}
+
+/*
+ * In a thread of the compute pool, the clients left or waited too long
+ */
+static int clustering_cancelled(void *data)
+{
+    ClusterJob_t *job = (ClusterJob_t *) data;
+    struct timespec now;
+
+    if (flight_abandoned(job->flight))
+    {
+        return 1;
+    }
+
+    if (!job->app->config->compute.deadline)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > job->deadline.tv_sec ||
+           (now.tv_sec == job->deadline.tv_sec && now.tv_nsec > job->deadline.tv_nsec);
+}
+
+/*
+ * In a thread of the compute pool
+ */
+static void run_clustering(void *data)
+{
+    ClusterJob_t *job = (ClusterJob_t *) data;
+    struct timespec begin, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    job->cancelled = !process_clustering(local_points(job->app), job->app->config, &job->query, job->output,
+                                         clustering_cancelled, job);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    job->milliseconds = (double) (end.tv_sec - begin.tv_sec) * 1000. + (double) (end.tv_nsec - begin.tv_nsec) / 1e6;
+}
 
 /*
- * Display the program usage
- *
- * @param args: The argument structure.
+ * Back in the loop of the first request, cache the result and give it to
+ * every waiting request
  */
-static void usage_if_needed(Argument_t *args)
+static void complete_clustering(void *data)
 {
-    if (args && args->help)
+    ClusterJob_t *job = (ClusterJob_t *) data;
+    Application_t *app = job->app;
+    CacheEntry_t *entry = NULL;
+    Body_t *body = NULL;
+
+    record_latency(app, &job->submitted);
+
+    if (job->cancelled)
     {
-        fprintf(stderr, "Usage: geocluster [OPTIONS]\n");
-        fprintf(stderr, "Options are:\n");
-        fprintf(stderr, "   -h|--help          : Display this message\n");
-        fprintf(stderr, "   -f|--file FILENAME : The file to inspect\n");
-        fprintf(stderr, "\n");
+        log_warning("Computation abandoned after %.2f ms", job->milliseconds);
+        flight_land(app->flights, job->flight, NULL);
+        evbuffer_free(job->output);
+        free(job);
+        return;
+    }
 
-        exit(EXIT_SUCCESS);
+    log_info("Computation done in %.2f ms", job->milliseconds);
+
+    if (job->cacheable && app->cache)
+    {
+        response_cache_lock(app->cache, job->key);
+        entry = response_cache_insert(app->cache, job->key, job->content_type);
+        body = body_retain(response_cache_set_body(app->cache, entry, ENCODING_IDENTITY, job->output));
+        response_cache_unlock(app->cache, job->key);
     }
+    else
+    {
+        body = body_create(job->output, NULL);
+    }
+
+    flight_land(app->flights, job->flight, body);
+    body_release(body);
+    evbuffer_free(job->output);
+    free(job);
 }
 
 /*
- * Do the clustering  with the database result.
+ * Compute a clustering in the thread of the request, for the backends
+ * without libevent loop to wake up
+ */
+static void compute_clustering(ServerExchange_t *exchange, Application_t *app, const Query_t *query,
+                               const char *key, const char *content_type, const char *vary, int cacheable)
+{
+    struct evbuffer *output = evbuffer_new();
+    CacheEntry_t *entry = NULL;
+    struct timespec begin, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    process_clustering(local_points(app), app->config, query, output, NULL, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    record_latency(app, &begin);
+    log_info("Computation done in %.2f ms",
+             (double) (end.tv_sec - begin.tv_sec) * 1000. + (double) (end.tv_nsec - begin.tv_nsec) / 1e6);
+
+    if (!cacheable || !app->cache)
+    {
+        send_body(exchange, app->config, output, content_type, vary);
+        return;
+    }
+
+    response_cache_lock(app->cache, key);
+    entry = response_cache_insert(app->cache, key, content_type);
+    response_cache_set_body(app->cache, entry, ENCODING_IDENTITY, output);
+    evbuffer_free(output);
+    send_entry(exchange, app->cache, app->config, key, entry, vary);
+}
+
+/*
+ * Compute a clustering in the compute pool, the loop goes on with the other
+ * connections. The identical requests in progress share one computation and
+ * its body. Replies 503 when too many are waiting, or when the computation
+ * is past the deadline.
  *
- * @param points_array:
+ * @param exchange: The request
+ * @param app: The application
+ * @param query: The request parameters, copied
+ * @param key: The normalized query
+ * @param content_type: The Content-Type header value
+ * @param vary: The Vary header value
+ * @param cacheable: Keep the result in the cache
  */
-static char *process_clustering(PointArray_t *points_array, Configuration_t *config, Bound_t bounds, int clusterize)
+static void submit_clustering(ServerExchange_t *exchange, Application_t *app, const Query_t *query,
+                              const char *key, const char *content_type, const char *vary, int cacheable)
 {
-    Cluster_t *cluster = NULL;
-    char *result = NULL;
+    ClusterWaiter_t *waiter = NULL;
+    ClusterJob_t *job = NULL;
+    unsigned int deadline = app->config->compute.deadline;
+    int first = 0;
 
-    uint8_t width = clusterize == 0 ? MaxSize : config->width;
-    uint8_t height = clusterize == 0 ? MaxSize : config->width;
+    if (!exchange->request)
+    {
+        compute_clustering(exchange, app, query, key, content_type, vary, cacheable);
+        return;
+    }
 
-    cluster = cluster_create(width, height, points_array);
-    cluster_set_bounds(cluster, bounds.north, bounds.south, bounds.east, bounds.west);
-    cluster_compute(cluster, config->excluded.lat, config->excluded.lng, clusterize);
-    result = convert_from_cluster(cluster);
-    cluster_dispose(cluster);
+    if (__atomic_add_fetch(&app->waiting, 1, __ATOMIC_RELAXED) > app->config->compute.requests)
+    {
+        log_warning("Too many requests waiting for a computation");
+        __atomic_sub_fetch(&app->waiting, 1, __ATOMIC_RELAXED);
+        send_overloaded(exchange, app->config);
+        return;
+    }
+
+    waiter = (ClusterWaiter_t *) malloc(sizeof(ClusterWaiter_t));
+    if (!waiter)
+    {
+        log_critical("Unable to allocate a clustering waiter");
+        exit(EXIT_FAILURE);
+    }
+
+    waiter->req = exchange->request;
+    waiter->connection = evhttp_request_get_connection(exchange->request);
+    waiter->app = app;
+    strncpy(waiter->key, key, sizeof(waiter->key) - 1);
+    waiter->key[sizeof(waiter->key) - 1] = '\0';
+    waiter->content_type = content_type;
+    waiter->vary = vary;
+    waiter->cacheable = cacheable;
+    waiter->gone = 0;
+    waiter->flight = flight_join(app->flights, key, evhttp_connection_get_base(waiter->connection),
+                                 on_clustering_landed, waiter, &first);
+    evhttp_connection_set_closecb(waiter->connection, on_waiter_connection_close, waiter);
+    waiter->watch = event_new(evhttp_connection_get_base(waiter->connection),
+                              bufferevent_getfd(evhttp_connection_get_bufferevent(waiter->connection)), EV_READ,
+                              on_waiter_readable, waiter);
+    event_add(waiter->watch, NULL);
+
+    if (!first)
+    {
+        log_debug("Waiting for the computation of %s", key);
+        return;
+    }
 
-    return result;
+    job = (ClusterJob_t *) malloc(sizeof(ClusterJob_t));
+    if (!job)
+    {
+        log_critical("Unable to allocate a clustering job");
+        exit(EXIT_FAILURE);
+    }
+
+    job->app = app;
+    job->flight = waiter->flight;
+    job->query = *query;
+    if (query->tile)
+    {
+        job->tile = *query->tile;
+        job->query.tile = &job->tile;
+    }
+    if (query->shift)
+    {
+        job->shift = *query->shift;
+        job->query.shift = &job->shift;
+    }
+    job->key = waiter->flight->key;
+    job->content_type = content_type;
+    job->cacheable = cacheable;
+    job->cancelled = 0;
+    job->output = evbuffer_new();
+
+    clock_gettime(CLOCK_MONOTONIC, &job->submitted);
+    job->deadline = job->submitted;
+    job->deadline.tv_sec += deadline / 1000;
+    job->deadline.tv_nsec += (long) (deadline % 1000) * 1000000L;
+    if (job->deadline.tv_nsec >= 1000000000L)
+    {
+        job->deadline.tv_sec++;
+        job->deadline.tv_nsec -= 1000000000L;
+    }
+
+    if (!compute_pool_submit(app->pool, evhttp_connection_get_base(waiter->connection), run_clustering,
+                             complete_clustering, job))
+    {
+        log_warning("The compute queue is full");
+        flight_land(app->flights, job->flight, NULL);
+        evbuffer_free(job->output);
+        free(job);
+    }
+}
+
+/*
+ * Send the response of a clustering query, from the cache or computed and
+ * added to it.
+ *
+ * @param exchange: The request
+ * @param app: The application
+ * @param query: The request parameters
+ * @param key: The normalized query
+ * @param content_type: The Content-Type header value
+ * @param vary: The Vary header value
+ */
+static void respond_clustering(ServerExchange_t *exchange, Application_t *app, const Query_t *query,
+                               const char *key, const char *content_type, const char *vary)
+{
+    CacheEntry_t *entry = NULL;
+
+    response_cache_lock(app->cache, key);
+    entry = response_cache_find(app->cache, key);
+    if (entry)
+    {
+        log_debug("Response of %s found in the cache", key);
+        send_entry(exchange, app->cache, app->config, key, entry, vary);
+        return;
+    }
+    response_cache_unlock(app->cache, key);
+
+    submit_clustering(exchange, app, query, key, content_type, vary, 1);
 }
 
 /*
  * Process the server request and send a response.
  * 
- * @param request: The server request
+ * @param exchange: The request
  * @param data: The data associated with the route
  */
-static void on_process_response(struct evhttp_request *req, void *data)
+static void on_process_response(ServerExchange_t *exchange, void *data)
 {
-    struct evkeyvalq params;
-    Configuration_t * config;
-    Bound_t bounds;
+    Application_t *app = (Application_t *) data;
+    static const char Vary[] = "Accept, Accept-Encoding";
+    Viewport_t viewport;
+    char token[DELTA_TOKEN_SIZE];
+    char key[QUERY_KEY_SIZE];
+    Shift_t shift;
+    Query_t query;
 
-    struct evbuffer *buf = NULL;
-    PointArray_t *array = NULL;
-    char *json_result = NULL;
-    int result = 0;
-    int clusterize = 1;
+    log_info("Got something from %s", exchange->remote_host);
 
-    log_info("Got something from %s", req->remote_host);
+    if (!parse_parameters(exchange, app->config, &query))
+    {
+        return;
+    }
+    query.binary_type = accepted_binary_type(exchange);
+    degrade_if_busy(exchange, app, &query);
 
-    array = ((Application_t *) data)->points;
-    config = ((Application_t *) data)->config;
+    viewport.version = app->version;
+    viewport.bounds = query.bounds;
+    viewport.clusterize = query.clusterize;
+    viewport.since = query.since;
+    viewport.until = query.until;
+    grid_size(app->config, &query, &viewport.width, &viewport.height);
+    delta_token_write(&viewport, token);
+    server_add_header(exchange, "X-Viewport-Token", token);
 
-    memset(&bounds, 0, sizeof(Bound_t));
+    /* Only the new cells when the client's grid lines up with this one, JSON only */
+    if (query.has_previous && !query.binary_type && !query.max_size &&
+        delta_shift(&query.previous, &viewport, &shift))
+    {
+        query.shift = &shift;
+    }
 
-    result = evhttp_parse_query_str(evhttp_uri_get_query(evhttp_request_get_evhttp_uri(req)), &params);
-    if (result == -1)
+    query_key("/", &query, key, sizeof(key));
+    if (not_modified(exchange, app, key, Vary))
     {
-        log_error("There's no parameters");
-        evhttp_send_reply(req, 400, "Bad Request", NULL);
         return;
     }
-    else
+
+    if (query.shift)
     {
-        int got_north = 0, got_west = 0, got_east = 0, got_south = 0;
+        submit_clustering(exchange, app, &query, key, "application/json", Vary, 0);
+        return;
+    }
 
-        log_debug("Got parameters: %s", req->uri);
-        for (struct evkeyval *i = params.tqh_first; i; i = i->next.tqe_next)
-        {
-            log_debug("Key: %s , Value: %s", i->key, i->value);
+    respond_clustering(exchange, app, &query, key, query.binary_type ? query.binary_type : "application/json", Vary);
+}
 
-            if (!strcmp("north", i->key))
-            {
-                bounds.north = atof(i->value);
-                got_north = 1;
-            }
-            else if (!strcmp("south", i->key))
-            {
-                bounds.south = atof(i->value);
-                got_south = 1;
-            }
-            else if (!strcmp("east", i->key))
-            {
-                bounds.east = atof(i->value);
-                got_east = 1;
-            }
-            else if (!strcmp("west", i->key))
-            {
-                bounds.west = atof(i->value);
-                got_west = 1;
-            }
-            else if (!strcmp("cluster", i->key))
-            {
-                clusterize = !strcmp("false", i->value) ? 0 : 1;
-            }
-            else
-            {
-                log_error("Unknown key %s, with this value %s\n", i->key, i->value);
-                evhttp_send_reply(req, 400, "Bad Request", NULL);
-                return;
-            }
-        }
+/*
+ * Count the points of each region in the bounds.
+ *
+ * @param exchange: The request
+ * @param data: The data associated with the route
+ */
+static void on_process_regions(ServerExchange_t *exchange, void *data)
+{
+    Application_t *app = (Application_t *) data;
+    RegionCount_t *counts = NULL;
+    struct evbuffer *buf = NULL;
+    char key[QUERY_KEY_SIZE];
+    PointArray_t view;
+    Query_t query;
 
-        log_debug("Parameters are: north:%f south:%f east:%f west:%f",
-                  bounds.north, bounds.south, bounds.east, bounds.west);
+    log_info("Got regions request from %s", exchange->remote_host);
 
+    if (!app->regions)
+    {
+        server_send_reply(exchange, 404, "Not Found: no regions configured", NULL);
+        return;
+    }
 
-        if (!(got_east && got_north && got_south && got_west))
-        {
-            log_error("Missing parameters");
-            evhttp_send_reply(req, 400, "Bad Request: Missing parameters", NULL);
-            return;
-        }
+    if (!parse_parameters(exchange, app->config, &query))
+    {
+        return;
+    }
 
-        clock_t begin = clock();
+    query_key("/regions", &query, key, sizeof(key));
+    if (not_modified(exchange, app, key, "Accept-Encoding"))
+    {
+        return;
+    }
 
-        json_result =  process_clustering(array, config, bounds, clusterize);
-        if (!json_result)
-        {
-            log_error("No results");
-            evhttp_send_reply(req, 200, "OK", NULL);
-            return;
-        }
+    clock_t begin = clock();
 
-        clock_t end = clock();
-        log_info("Computation done in %.2f ms", ((float) (end - begin) / CLOCKS_PER_SEC) * 1000.f);
+    points_array_time_range(local_points(app), query.since, query.until, &view);
+    counts = region_aggregate(app->regions, &view, query.bounds);
+    buf = evbuffer_new();
+    convert_from_regions(app->regions, counts, buf, query.precision);
+    send_body(exchange, app->config, buf, "application/json", "Accept-Encoding");
+    free(counts);
 
-        buf = evbuffer_new();
-        evbuffer_add_printf(buf, "%s", json_result);
-        evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "application/json");
-        evhttp_send_reply(req, 200, "OK", buf);
+    clock_t end = clock();
+    log_info("Regions done in %.2f ms", ((float) (end - begin) / CLOCKS_PER_SEC) * 1000.f);
+}
 
-        free(json_result);
-        evbuffer_free(buf);
+/*
+ * Stream the raw points of the bounds and the time range as NDJSON.
+ *
+ * @param exchange: The request
+ * @param data: The data associated with the route
+ */
+static void on_process_points(ServerExchange_t *exchange, void *data)
+{
+    Application_t *app = (Application_t *) data;
+    char key[QUERY_KEY_SIZE];
+    PointArray_t view;
+    Query_t query;
+
+    log_info("Got points request from %s", exchange->remote_host);
+
+    /* Streamed with the chunks of libevent */
+    if (!exchange->request)
+    {
+        server_send_reply(exchange, 501, "Not Implemented", NULL);
+        return;
+    }
+
+    if (!parse_parameters(exchange, app->config, &query))
+    {
+        return;
+    }
+
+    query_key("/points", &query, key, sizeof(key));
+    if (not_modified(exchange, app, key, "Accept-Encoding"))
+    {
+        return;
+    }
+
+    points_array_time_range(local_points(app), query.since, query.until, &view);
+    export_points(exchange->request, &view, query.bounds, query.precision);
+}
+
+/*
+ * Cluster the points of a /tiles/{z}/{x}/{y}.mvt tile, and send it as a
+ * Mapbox Vector Tile.
+ *
+ * @param exchange: The request
+ * @param data: The data associated with the route
+ */
+static void on_process_tile(ServerExchange_t *exchange, void *data)
+{
+    Application_t *app = (Application_t *) data;
+    char key[QUERY_KEY_SIZE];
+    Query_t query;
+    Tile_t tile;
+
+    log_info("Got tile request from %s", exchange->remote_host);
+
+    if (!mvt_parse_tile(exchange->path, &tile))
+    {
+        server_send_reply(exchange, 404, "Not Found", NULL);
+        return;
+    }
+
+    memset(&query, 0, sizeof(Query_t));
+    query.clusterize = 1;
+    query.tile = &tile;
+    mvt_tile_bounds(&tile, &query.bounds);
+    degrade_if_busy(exchange, app, &query);
+
+    query_key(NULL, &query, key, sizeof(key));
+    if (not_modified(exchange, app, key, "Accept-Encoding"))
+    {
+        return;
     }
+
+    respond_clustering(exchange, app, &query, key, "application/vnd.mapbox-vector-tile", "Accept-Encoding");
 }
 
-static void start_web_server(Configuration_t * config, PointArray_t *points)
+/*
+ * What the server processes serve
+ */
+typedef struct
+{
+    Configuration_t *config;
+    PointArray_t *points;
+    PointArray_t **replicas;
+    int nodes;
+    RegionSet_t *regions;
+    uint64_t version;
+    int socket;
+    int unix_socket;
+    int index;
+} Worker_t;
+
+/*
+ * Run the server until it is stopped
+ *
+ * @param worker: The points and the sockets, socket is -1 to bind the configured port
+ */
+static void start_web_server(const Worker_t *worker)
 {
+    Configuration_t *config = worker->config;
     Server_t *server = NULL;
-    Application_t container = {config, points};
+    Application_t container = {config, worker->points, worker->regions, NULL, NULL, NULL, 0, 0, worker->version,
+                               worker->replicas, worker->nodes};
 
     log_info("Start as micro service.");
 
-    server = server_create(config->server.address, config->server.port);
+    server = server_create(config->server.address, config->server.port, config->server.workers);
+    if (worker->socket >= 0)
+    {
+        server_set_socket(server, worker->socket);
+    }
+    if (worker->unix_socket >= 0)
+    {
+        /* Behind a proxy of the host, the port is only served when set */
+        server_set_unix_socket(server, worker->unix_socket, config->server.port != 0);
+    }
+    if (config->server.io_uring)
+    {
+        log_warning("The io_uring backend is experimental, the clusters are computed in the loops "
+                    "without the [compute] limits");
+        server_set_backend(server, SERVER_BACKEND_IO_URING);
+    }
+    server_set_affinity(server, &config->affinity.server, (size_t) worker->index);
     server_add_route(server, "/", (ServerCallback) on_process_response, &container);
+    server_add_route(server, "/regions", (ServerCallback) on_process_regions, &container);
+    server_add_route(server, "/points", (ServerCallback) on_process_points, &container);
+    server_add_prefix_route(server, "/tiles/", (ServerCallback) on_process_tile, &container);
+
+    if (config->cache.entries)
+    {
+        container.cache = response_cache_create(config->cache.entries, config->cache.disk_min_size,
+                                                config->cache.directory);
+    }
+
+    container.pool = compute_pool_create(config->compute.threads, config->compute.queue);
+    compute_pool_set_affinity(container.pool, &config->affinity.compute, (size_t) worker->index);
+    container.flights = flight_table_create();
 
     server_run(server);
+    compute_pool_dispose(container.pool);
+    flight_table_dispose(container.flights);
     server_dispose(server);
+    response_cache_dispose(container.cache);
+
+}
+
+static void run_worker_process(int index, void *data)
+{
+    Worker_t worker = *(Worker_t *) data;
+
+    worker.index = index;
+    start_web_server(&worker);
+}
+
+/*
+ * Copy the points on every NUMA node, nothing is done on a single one
+ *
+ * @param points: The points
+ * @param nodes: Set to the count of nodes
+ * @return The copies by node, or NULL
+ */
+static PointArray_t **replicate_points(PointArray_t *points, int *nodes)
+{
+    PointArray_t **replicas = NULL;
+
+    *nodes = affinity_nodes();
+    if (*nodes < 2)
+    {
+        log_info("A single NUMA node, the points are not copied");
+        return NULL;
+    }
+
+    replicas = (PointArray_t **) calloc((size_t) *nodes, sizeof(PointArray_t *));
+    if (!replicas)
+    {
+        log_critical("Unable to allocate the copies of the points");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int node = 0; node < *nodes; node++)
+    {
+        replicas[node] = affinity_replicate(points, node);
+    }
 
+    return replicas;
 }
 
 static FILE *initialize_log(Configuration_t *config)
@@ -237,12 +1530,60 @@ PointArray_t * get_points_from_database(Configuration_t * config)
     PointArray_t * points = NULL;
 
     db = database_connect(config);
-    points = database_execute(db);
+    points = database_execute(db, config->database.time_column);
     mysql_close(db);
 
     return points;
 }
 
+PointArray_t * get_points_from_file(Configuration_t * config, const char * filename)
+{
+    log_info("Load the points from %s", filename);
+
+    return importer_load(filename, config->import.format, config->import.threads);
+}
+
+/*
+ * Get the points from the shared segment, the file or the database,
+ * then publish them when this process is the loader.
+ */
+static PointArray_t *load_points(Configuration_t *config, Argument_t *args, RegionSet_t *regions, uint64_t *version)
+{
+    PointArray_t *points = NULL;
+
+    /* The published points already carry their region */
+    if (config->shared.mode == SHARED_MODE_ATTACH && !args->publish)
+    {
+        return shared_store_attach(config->shared.name, region_digest(regions), config->shared.wait, version);
+    }
+
+    points = args->filename
+             ? get_points_from_file(config, args->filename)
+             : get_points_from_database(config);
+    if (!points)
+    {
+        return NULL;
+    }
+
+    exclusion_apply(&config->excluded, points);
+    if (regions)
+    {
+        region_assign(regions, points);
+    }
+    points_array_sort_by_time(points);
+
+    /* The version of the data, given to the clients with the responses: the
+     * same points, regions and exclusions give the same ETags on every host */
+    *version = points_array_digest(points, region_digest(regions) ^ exclusion_digest(&config->excluded));
+
+    if (config->shared.mode == SHARED_MODE_PUBLISH || args->publish)
+    {
+        points = shared_store_publish(config->shared.name, points, region_digest(regions), *version);
+    }
+
+    return points;
+}
+
 int main(int argc, char **argv)
 {
 //    Application_t app;
@@ -250,6 +1591,9 @@ int main(int argc, char **argv)
     Configuration_t *config = NULL;
     FILE *log_file = NULL;
     PointArray_t * points;
+    RegionSet_t * regions = NULL;
+    uint64_t version = 0;
+    Worker_t worker;
 
     log_file = initialize_log(config);
 
@@ -259,10 +1603,59 @@ int main(int argc, char **argv)
 
     config = configuration_read(args->config_file);
 
-    points = get_points_from_database(config);
-    start_web_server(config, points);
+    if (config->regions.file)
+    {
+        regions = region_load(config->regions.file, config->regions.id_property, config->regions.name_property);
+    }
+
+    points = load_points(config, args, regions, &version);
+    worker = (Worker_t) {config, points, NULL, 0, regions, version, -1, -1, 0};
+    if (!args->publish && config->affinity.replicate)
+    {
+        worker.replicas = replicate_points(points, &worker.nodes);
+    }
+    if (!args->publish && config->server.unix_socket)
+    {
+        worker.unix_socket = server_listen_unix(config->server.unix_socket);
+        log_info("Listening on %s", config->server.unix_socket);
+    }
+
+    if (!args->publish && args->workers)
+    {
+        /* The points are loaded once, the forked workers share them */
+        if (worker.unix_socket < 0 || config->server.port)
+        {
+            worker.socket = server_listen(config->server.address, config->server.port, 0);
+            log_info("Listening on %s:%d", config->server.address, config->server.port);
+        }
+        log_info("Serving with %d worker processes", args->workers);
+        prefork_run(args->workers, run_worker_process, &worker);
+        if (worker.socket >= 0)
+        {
+            close(worker.socket);
+        }
+        if (worker.unix_socket >= 0)
+        {
+            close(worker.unix_socket);
+        }
+    }
+    else if (!args->publish)
+    {
+        start_web_server(&worker);
+    }
+
+    if (worker.unix_socket >= 0)
+    {
+        unlink(config->server.unix_socket);
+    }
 
     log_info("Shutting down");
+    for (int node = 0; worker.replicas && node < worker.nodes; node++)
+    {
+        affinity_replica_dispose(worker.replicas[node]);
+    }
+    free(worker.replicas);
+    region_dispose(regions);
     configuration_dispose(config);
     argument_dispose(args);
     if (log_file != NULL)
@@ -0,0 +1,226 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "msgpack_convertion.h"
+#include "cluster.h"
+#include "convert.h"
+#include "buffer_writer.h"
+#include "json_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The largest item but the strings: a float64 and its type */
+#define MSGPACK_ITEM_MAX 9
+
+#define MSGPACK_NIL 0xc0
+#define MSGPACK_STR8 0xd9
+#define MSGPACK_STR16 0xda
+#define MSGPACK_STR32 0xdb
+#define MSGPACK_UINT32 0xce
+#define MSGPACK_FLOAT64 0xcb
+#define MSGPACK_ARRAY16 0xdc
+#define MSGPACK_ARRAY32 0xdd
+#define MSGPACK_FIXMAP 0x80
+#define MSGPACK_FIXSTR 0xa0
+
+static inline void _write_byte(BufferWriter_t *writer, unsigned char byte) {
+    buffer_writer_reserve(writer, 1);
+    *writer->cursor++ = (char) byte;
+}
+
+/* Big endian, as MessagePack wants */
+static inline void _write_big_endian(BufferWriter_t *writer, unsigned char type, uint64_t value, int size) {
+    buffer_writer_reserve(writer, MSGPACK_ITEM_MAX);
+    *writer->cursor++ = (char) type;
+    for (int shift = (size - 1) * 8; shift >= 0; shift -= 8) {
+        *writer->cursor++ = (char) (value >> shift);
+    }
+}
+
+static inline void _write_uint32(BufferWriter_t *writer, uint32_t value) {
+    _write_big_endian(writer, MSGPACK_UINT32, value, 4);
+}
+
+static inline void _write_float64(BufferWriter_t *writer, double value) {
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    _write_big_endian(writer, MSGPACK_FLOAT64, bits, 8);
+}
+
+static inline void _write_array(BufferWriter_t *writer, size_t length) {
+    if (length <= 0xFFFF) {
+        _write_big_endian(writer, MSGPACK_ARRAY16, length, 2);
+    } else {
+        _write_big_endian(writer, MSGPACK_ARRAY32, length, 4);
+    }
+}
+
+/*
+ * A key known to be shorter than 32 bytes
+ */
+static void _write_key(BufferWriter_t *writer, const char *key) {
+    size_t length = strlen(key);
+
+    buffer_writer_reserve(writer, length + 1);
+    *writer->cursor++ = (char) (MSGPACK_FIXSTR | length);
+    memcpy(writer->cursor, key, length);
+    writer->cursor += length;
+}
+
+static void _write_string(BufferWriter_t *writer, const char *value) {
+    size_t length = strlen(value);
+
+    if (length <= 0xFF) {
+        _write_big_endian(writer, MSGPACK_STR8, length, 1);
+    } else if (length <= 0xFFFF) {
+        _write_big_endian(writer, MSGPACK_STR16, length, 2);
+    } else {
+        _write_big_endian(writer, MSGPACK_STR32, length, 4);
+    }
+
+    buffer_writer_reserve(writer, length);
+    memcpy(writer->cursor, value, length);
+    writer->cursor += length;
+}
+
+static void _write_cell(BufferWriter_t *writer, Cluster_t *cell) {
+    size_t length = cell->points_array->length;
+
+    if (!length) {
+        _write_byte(writer, MSGPACK_NIL);
+        return;
+    }
+
+    if (length == 1) {
+        Point_t *point = cell->points_array->points[0];
+        int has_desc = point->desc && json_writer_valid_utf8(point->desc);
+
+        _write_byte(writer, (unsigned char) (MSGPACK_FIXMAP | (has_desc ? 5 : 4)));
+        if (has_desc) {
+            _write_key(writer, "desc");
+            _write_string(writer, point->desc);
+        }
+        _write_key(writer, "id");
+        _write_uint32(writer, point->pk);
+        _write_key(writer, "count");
+        _write_uint32(writer, 1);
+        _write_key(writer, "lat");
+        _write_float64(writer, convert_lat_to_gps(point->position.lat));
+        _write_key(writer, "lng");
+        _write_float64(writer, convert_lng_to_gps(point->position.lng));
+        return;
+    }
+
+    cluster_compute_barycenter(cell);
+    _write_byte(writer, MSGPACK_FIXMAP | 3);
+    _write_key(writer, "count");
+    _write_uint32(writer, (uint32_t) length);
+    _write_key(writer, "lat");
+    _write_float64(writer, convert_lat_to_gps(cell->lat));
+    _write_key(writer, "lng");
+    _write_float64(writer, convert_lng_to_gps(cell->lng));
+}
+
+static void _write_grid(BufferWriter_t *writer, Cluster_t *root, Cluster_t ***cluster) {
+    _write_array(writer, root->height);
+    for (register int i = 0; i < root->height; i++) {
+        _write_array(writer, root->width);
+        for (register int j = 0; j < root->width; j++) {
+            _write_cell(writer, cluster[i][j]);
+        }
+    }
+}
+
+static void _write_columns(BufferWriter_t *writer, Cluster_t *root, Cluster_t ***cluster) {
+    size_t count;
+    ClusterCell_t *cells = cluster_collect_cells(root, cluster, NULL, &count);
+
+    _write_byte(writer, MSGPACK_FIXMAP | 5);
+    _write_key(writer, "cell");
+    _write_array(writer, count);
+    for (size_t k = 0; k < count; k++) {
+        _write_uint32(writer, cells[k].index);
+    }
+    _write_key(writer, "count");
+    _write_array(writer, count);
+    for (size_t k = 0; k < count; k++) {
+        _write_uint32(writer, cells[k].count);
+    }
+    _write_key(writer, "lat");
+    _write_array(writer, count);
+    for (size_t k = 0; k < count; k++) {
+        _write_float64(writer, cells[k].lat);
+    }
+    _write_key(writer, "lng");
+    _write_array(writer, count);
+    for (size_t k = 0; k < count; k++) {
+        _write_float64(writer, cells[k].lng);
+    }
+    _write_key(writer, "id");
+    _write_array(writer, count);
+    for (size_t k = 0; k < count; k++) {
+        if (cells[k].point) {
+            _write_uint32(writer, cells[k].point->pk);
+        } else {
+            _write_byte(writer, MSGPACK_NIL);
+        }
+    }
+
+    free(cells);
+}
+
+void convert_from_cluster_msgpack(Cluster_t *cluster, struct evbuffer *output, int sparse) {
+    BufferWriter_t writer;
+
+    buffer_writer_init(&writer, output);
+
+    if (sparse) {
+        _write_byte(&writer, MSGPACK_FIXMAP | 4);
+        _write_key(&writer, "width");
+        _write_uint32(&writer, cluster->width);
+        _write_key(&writer, "height");
+        _write_uint32(&writer, cluster->height);
+        _write_key(&writer, "uncleaned");
+        _write_columns(&writer, cluster, cluster->groups_disappeared);
+        _write_key(&writer, "cleaned");
+        _write_columns(&writer, cluster, cluster->groups_exists);
+    } else {
+        _write_byte(&writer, MSGPACK_FIXMAP | 2);
+        _write_key(&writer, "uncleaned");
+        _write_grid(&writer, cluster, cluster->groups_disappeared);
+        _write_key(&writer, "cleaned");
+        _write_grid(&writer, cluster, cluster->groups_exists);
+    }
+
+    buffer_writer_commit(&writer);
+}
@@ -0,0 +1,325 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mvt_convertion.h"
+#include "convert.h"
+#include "number.h"
+#include "log.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The protobuf keys: field number << 3 | wire type */
+#define PB_VARINT 0
+#define PB_LENGTH 2
+#define PB_KEY(field, type) ((unsigned char) ((field) << 3 | (type)))
+
+#define TILE_LAYERS 3
+
+#define LAYER_NAME 1
+#define LAYER_FEATURES 2
+#define LAYER_KEYS 3
+#define LAYER_VALUES 4
+#define LAYER_EXTENT 5
+#define LAYER_VERSION 15
+
+#define FEATURE_TAGS 2
+#define FEATURE_TYPE 3
+#define FEATURE_GEOMETRY 4
+#define FEATURE_POINT 1
+
+#define VALUE_UINT 5
+#define VALUE_BOOL 7
+
+#define COMMAND_MOVE_TO(count) ((1 & 0x7) | ((count) << 3))
+
+/* A varint of a uint64, and of a uint32 */
+#define VARINT_MAX 10
+#define VARINT32_MAX 5
+
+/* The keys of the layer, the order gives their index */
+static const char *const Keys[] = {"count", "cleaned", "id"};
+
+enum {
+    KEY_COUNT,
+    KEY_CLEANED,
+    KEY_ID,
+};
+
+/* The values of the layer, false and true come first */
+enum {
+    VALUE_FALSE,
+    VALUE_TRUE,
+    VALUE_FIRST_UINT,
+};
+
+/*
+ * Deduplicate the uint values of the layer with an open addressing table
+ */
+typedef struct {
+    uint64_t *values;
+    uint32_t *indices;
+    size_t capacity;
+    uint32_t length;
+    struct evbuffer *encoded;
+} ValueTable_t;
+
+static size_t _write_varint(unsigned char *buffer, uint64_t value) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        buffer[length++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (unsigned char) value;
+
+    return length;
+}
+
+static void _add_varint(struct evbuffer *output, uint64_t value) {
+    unsigned char buffer[VARINT_MAX];
+
+    evbuffer_add(output, buffer, _write_varint(buffer, value));
+}
+
+static void _add_string(struct evbuffer *output, unsigned char key, const char *value) {
+    size_t length = strlen(value);
+
+    evbuffer_add(output, &key, 1);
+    _add_varint(output, length);
+    evbuffer_add(output, value, length);
+}
+
+static uint32_t _zigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static void _value_table_init(ValueTable_t *table, size_t cells) {
+    unsigned char encoded[] = {PB_KEY(LAYER_VALUES, PB_LENGTH), 2, PB_KEY(VALUE_BOOL, PB_VARINT), 0};
+
+    /* A count and an id by cell at most, half full */
+    table->capacity = 16;
+    while (table->capacity < cells * 4) {
+        table->capacity <<= 1;
+    }
+
+    table->values = malloc(table->capacity * sizeof(uint64_t));
+    table->indices = malloc(table->capacity * sizeof(uint32_t));
+    if (!table->values || !table->indices) {
+        log_critical("Unable to allocate the values of the tile");
+        exit(EXIT_FAILURE);
+    }
+    memset(table->indices, 0xFF, table->capacity * sizeof(uint32_t));
+
+    table->encoded = evbuffer_new();
+    table->length = VALUE_FIRST_UINT;
+
+    evbuffer_add(table->encoded, encoded, sizeof(encoded));
+    encoded[3] = 1;
+    evbuffer_add(table->encoded, encoded, sizeof(encoded));
+}
+
+static void _value_table_dispose(ValueTable_t *table) {
+    free(table->values);
+    free(table->indices);
+    evbuffer_free(table->encoded);
+}
+
+/*
+ * Get the index of a uint value, adding it to the layer the first time
+ */
+static uint32_t _value_table_uint(ValueTable_t *table, uint64_t value) {
+    size_t slot = (size_t) ((value * 0x9E3779B97F4A7C15ULL) >> 32) & (table->capacity - 1);
+    unsigned char encoded[2 + 1 + VARINT_MAX];
+    size_t length;
+
+    while (table->indices[slot] != UINT32_MAX) {
+        if (table->values[slot] == value) {
+            return table->indices[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    table->values[slot] = value;
+    table->indices[slot] = table->length;
+
+    encoded[0] = PB_KEY(LAYER_VALUES, PB_LENGTH);
+    encoded[2] = PB_KEY(VALUE_UINT, PB_VARINT);
+    length = _write_varint(encoded + 3, value);
+    encoded[1] = (unsigned char) (length + 1);
+    evbuffer_add(table->encoded, encoded, length + 3);
+
+    return table->length++;
+}
+
+/*
+ * Project GPS coordinates in the tile, Web Mercator
+ */
+static void _project(const Tile_t *tile, double lat, double lng, int32_t *x, int32_t *y) {
+    double scale = (double) ((uint64_t) 1 << tile->z);
+    double sin_lat = sin(lat * M_PI / 180.);
+    double world_x = (lng + 180.) / 360. * scale;
+    double world_y = (0.5 - log((1. + sin_lat) / (1. - sin_lat)) / (4. * M_PI)) * scale;
+
+    *x = (int32_t) lround((world_x - tile->x) * MVT_EXTENT);
+    *y = (int32_t) lround((world_y - tile->y) * MVT_EXTENT);
+}
+
+static void _add_feature(struct evbuffer *features, ValueTable_t *table, const Tile_t *tile, Cluster_t *cell,
+                         int cleaned) {
+    unsigned char tags[6 * VARINT32_MAX], geometry[3 * VARINT32_MAX];
+    unsigned char feature[2 + sizeof(tags) + 2 + 2 + sizeof(geometry)];
+    unsigned char header[1 + VARINT32_MAX];
+    size_t tags_length = 0, geometry_length = 0, length = 0;
+    size_t count = cell->points_array->length;
+    double lat, lng;
+    int32_t x, y;
+
+    if (count == 1) {
+        lat = cell->points_array->points[0]->position.lat;
+        lng = cell->points_array->points[0]->position.lng;
+    } else {
+        cluster_compute_barycenter(cell);
+        lat = cell->lat;
+        lng = cell->lng;
+    }
+    _project(tile, convert_lat_to_gps(lat), convert_lng_to_gps(lng), &x, &y);
+
+    tags_length += _write_varint(tags + tags_length, KEY_COUNT);
+    tags_length += _write_varint(tags + tags_length, _value_table_uint(table, count));
+    tags_length += _write_varint(tags + tags_length, KEY_CLEANED);
+    tags_length += _write_varint(tags + tags_length, cleaned ? VALUE_TRUE : VALUE_FALSE);
+    if (count == 1) {
+        tags_length += _write_varint(tags + tags_length, KEY_ID);
+        tags_length += _write_varint(tags + tags_length,
+                                     _value_table_uint(table, cell->points_array->points[0]->pk));
+    }
+
+    geometry_length += _write_varint(geometry + geometry_length, COMMAND_MOVE_TO(1));
+    geometry_length += _write_varint(geometry + geometry_length, _zigzag(x));
+    geometry_length += _write_varint(geometry + geometry_length, _zigzag(y));
+
+    feature[length++] = PB_KEY(FEATURE_TAGS, PB_LENGTH);
+    length += _write_varint(feature + length, tags_length);
+    memcpy(feature + length, tags, tags_length);
+    length += tags_length;
+    feature[length++] = PB_KEY(FEATURE_TYPE, PB_VARINT);
+    feature[length++] = FEATURE_POINT;
+    feature[length++] = PB_KEY(FEATURE_GEOMETRY, PB_LENGTH);
+    length += _write_varint(feature + length, geometry_length);
+    memcpy(feature + length, geometry, geometry_length);
+    length += geometry_length;
+
+    header[0] = PB_KEY(LAYER_FEATURES, PB_LENGTH);
+    evbuffer_add(features, header, 1 + _write_varint(header + 1, length));
+    evbuffer_add(features, feature, length);
+}
+
+static void _add_features(struct evbuffer *features, ValueTable_t *table, const Tile_t *tile, Cluster_t *root,
+                          Cluster_t ***cluster, int cleaned) {
+    for (register int i = 0; i < root->height; i++) {
+        for (register int j = 0; j < root->width; j++) {
+            if (cluster[i][j]->points_array->length) {
+                _add_feature(features, table, tile, cluster[i][j], cleaned);
+            }
+        }
+    }
+}
+
+int mvt_parse_tile(const char *path, Tile_t *tile) {
+    const char *end = path + strlen(path);
+    const char *p;
+
+    if (strncmp(path, "/tiles/", 7) != 0) {
+        return 0;
+    }
+
+    p = number_parse_uint32(path + 7, end, &tile->z);
+    if (!p || *p != '/' || tile->z > MVT_MAX_ZOOM) {
+        return 0;
+    }
+
+    p = number_parse_uint32(p + 1, end, &tile->x);
+    if (!p || *p != '/') {
+        return 0;
+    }
+
+    p = number_parse_uint32(p + 1, end, &tile->y);
+    if (!p || strcmp(p, ".mvt") != 0) {
+        return 0;
+    }
+
+    return tile->x < ((uint64_t) 1 << tile->z) && tile->y < ((uint64_t) 1 << tile->z);
+}
+
+void mvt_tile_bounds(const Tile_t *tile, Bound_t *bounds) {
+    double scale = (double) ((uint64_t) 1 << tile->z);
+
+    bounds->west = tile->x / scale * 360. - 180.;
+    bounds->east = (tile->x + 1) / scale * 360. - 180.;
+    bounds->north = atan(sinh(M_PI * (1. - 2. * tile->y / scale))) * 180. / M_PI;
+    bounds->south = atan(sinh(M_PI * (1. - 2. * (tile->y + 1) / scale))) * 180. / M_PI;
+}
+
+void convert_from_cluster_mvt(Cluster_t *cluster, const Tile_t *tile, struct evbuffer *output) {
+    struct evbuffer *features = evbuffer_new();
+    ValueTable_t table;
+    unsigned char header[2 + VARINT_MAX];
+
+    _value_table_init(&table, (size_t) cluster->width * cluster->height * 2);
+    _add_features(features, &table, tile, cluster, cluster->groups_disappeared, 0);
+    _add_features(features, &table, tile, cluster, cluster->groups_exists, 1);
+
+    if (evbuffer_get_length(features)) {
+        struct evbuffer *layer = evbuffer_new();
+
+        header[0] = PB_KEY(LAYER_VERSION, PB_VARINT);
+        header[1] = 2;
+        evbuffer_add(layer, header, 2);
+        _add_string(layer, PB_KEY(LAYER_NAME, PB_LENGTH), "clusters");
+        evbuffer_add_buffer(layer, features);
+        for (size_t i = 0; i < sizeof(Keys) / sizeof(Keys[0]); i++) {
+            _add_string(layer, PB_KEY(LAYER_KEYS, PB_LENGTH), Keys[i]);
+        }
+        evbuffer_add_buffer(layer, table.encoded);
+        header[0] = PB_KEY(LAYER_EXTENT, PB_VARINT);
+        evbuffer_add(layer, header, 1 + _write_varint(header + 1, MVT_EXTENT));
+
+        header[0] = PB_KEY(TILE_LAYERS, PB_LENGTH);
+        evbuffer_add(output, header, 1 + _write_varint(header + 1, evbuffer_get_length(layer)));
+        evbuffer_add_buffer(output, layer);
+        evbuffer_free(layer);
+    }
+
+    evbuffer_free(features);
+    _value_table_dispose(&table);
+}
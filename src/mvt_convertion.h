@@ -0,0 +1,81 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MVT_CONVERTION_H__
+#define __MVT_CONVERTION_H__
+
+#include "cluster.h"
+#include "config.h"
+
+#include <event2/buffer.h>
+#include <stdint.h>
+
+/* The deepest zoom, 2^z tiles must fit a uint32 */
+#define MVT_MAX_ZOOM 24
+
+/* The tile coordinates, from 0 to 4096 */
+#define MVT_EXTENT 4096
+
+typedef struct
+{
+    uint32_t z, x, y;
+} Tile_t;
+
+/*
+ * Read the tile of a /tiles/{z}/{x}/{y}.mvt path
+ *
+ * @param path: The URL path
+ * @param tile: Where to store the tile
+ * @return 1 if the path is a valid tile
+ */
+int mvt_parse_tile(const char *path, Tile_t *tile);
+
+/*
+ * Compute the GPS bounds of a tile, in the Web Mercator tiling scheme
+ *
+ * @param tile: The tile
+ * @param bounds: Where to store the bounds
+ */
+void mvt_tile_bounds(const Tile_t *tile, Bound_t *bounds);
+
+/*
+ * Write the result of the computation as a Mapbox Vector Tile at the end of the
+ * buffer: a "clusters" layer with a point by non empty cell, at its barycenter,
+ * with the count, cleaned and id (for a single point) properties. A tile without
+ * any point is empty.
+ *
+ * @param cluster: The cluster computed on the tile bounds
+ * @param tile: The tile
+ * @param output: The buffer to append to
+ */
+void convert_from_cluster_mvt(Cluster_t * cluster, const Tile_t * tile, struct evbuffer * output);
+
+#endif
@@ -0,0 +1,585 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "number.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_MAX_TEXT 64
+
+/*
+ * Exact powers of ten representable as a double. Any mantissa below 2^53
+ * scaled by one of them gives a correctly rounded result (Clinger's fast path).
+ */
+static const double Power10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define POWER10_MAX 22
+#define MANTISSA_MAX (((uint64_t) 1) << 53)
+
+static inline int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * Slow but exact path, only taken for unusual inputs (very long mantissa or huge exponent).
+ */
+static const char *parse_double_slow(const char *begin, const char *stop, double *value)
+{
+    char text[NUMBER_MAX_TEXT];
+    size_t length = (size_t) (stop - begin);
+
+    if (length >= NUMBER_MAX_TEXT)
+    {
+        return NULL;
+    }
+
+    memcpy(text, begin, length);
+    text[length] = '\0';
+    *value = strtod(text, NULL);
+
+    return stop;
+}
+
+const char *number_parse_double(const char *begin, const char *end, double *value)
+{
+    const char *p = begin;
+    uint64_t mantissa = 0;
+    int negative = 0, digits = 0, significant = 0, exponent = 0, dropped = 0, truncated = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    for (; p < end && is_digit(*p); p++, digits++)
+    {
+        if (significant < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+            significant += mantissa != 0;
+        }
+        else
+        {
+            dropped++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && is_digit(*p); p++, digits++)
+        {
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+            else
+            {
+                truncated = 1;
+            }
+        }
+    }
+
+    if (!digits)
+    {
+        return NULL;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        int exp_negative = 0, exp_value = 0;
+
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            exp_negative = *q == '-';
+            q++;
+        }
+
+        if (q == end || !is_digit(*q))
+        {
+            return NULL;
+        }
+
+        for (; q < end && is_digit(*q); q++)
+        {
+            if (exp_value < 10000)
+            {
+                exp_value = exp_value * 10 + (*q - '0');
+            }
+        }
+
+        exponent += exp_negative ? -exp_value : exp_value;
+        p = q;
+    }
+
+    exponent += dropped;
+
+    if (dropped || truncated || mantissa >= MANTISSA_MAX || exponent < -POWER10_MAX || exponent > POWER10_MAX)
+    {
+        return parse_double_slow(begin, p, value);
+    }
+
+    *value = exponent < 0
+             ? (double) mantissa / Power10[-exponent]
+             : (double) mantissa * Power10[exponent];
+
+    if (negative)
+    {
+        *value = -*value;
+    }
+
+    return p;
+}
+
+const char *number_parse_uint32(const char *begin, const char *end, uint32_t *value)
+{
+    const char *p = begin;
+    uint64_t result = 0;
+
+    if (p == end || !is_digit(*p))
+    {
+        return NULL;
+    }
+
+    for (; p < end && is_digit(*p); p++)
+    {
+        result = result * 10 + (uint64_t) (*p - '0');
+        if (result > UINT32_MAX)
+        {
+            return NULL;
+        }
+    }
+
+    *value = (uint32_t) result;
+
+    return p;
+}
+
+/*
+ * Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers"), the same variant as RapidJSON and V8. The digits
+ * always read back to the same double and are the shortest in nearly all cases.
+ */
+
+typedef struct DiyFp_t
+{
+    uint64_t f;
+    int e;
+} DiyFp_t;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS + 1)
+
+/* 10^k normalized on 64 bits for k = -348, -340, ..., 340 */
+static const uint64_t CachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t CachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t Power10Int[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+static DiyFp_t diyfp_from_double(double value)
+{
+    DiyFp_t result;
+    uint64_t bits;
+    int biased;
+
+    memcpy(&bits, &value, sizeof(bits));
+    biased = (int) ((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+    result.f = bits & DP_SIGNIFICAND_MASK;
+
+    if (biased)
+    {
+        result.f += DP_HIDDEN_BIT;
+        result.e = biased - DP_EXPONENT_BIAS;
+    }
+    else
+    {
+        result.e = DP_MIN_EXPONENT;
+    }
+
+    return result;
+}
+
+static DiyFp_t diyfp_multiply(DiyFp_t a, DiyFp_t b)
+{
+    unsigned __int128 product = (unsigned __int128) a.f * b.f;
+    DiyFp_t result;
+
+    result.f = (uint64_t) (product >> 64) + ((uint64_t) (product >> 63) & 1);
+    result.e = a.e + b.e + 64;
+
+    return result;
+}
+
+static DiyFp_t diyfp_normalize(DiyFp_t value)
+{
+    int shift = __builtin_clzll(value.f);
+
+    value.f <<= shift;
+    value.e -= shift;
+
+    return value;
+}
+
+static void diyfp_boundaries(DiyFp_t value, DiyFp_t *minus, DiyFp_t *plus)
+{
+    DiyFp_t high = {(value.f << 1) + 1, value.e - 1};
+
+    high = diyfp_normalize(high);
+
+    if (value.f == DP_HIDDEN_BIT)
+    {
+        minus->f = (value.f << 2) - 1;
+        minus->e = value.e - 2;
+    }
+    else
+    {
+        minus->f = (value.f << 1) - 1;
+        minus->e = value.e - 1;
+    }
+
+    minus->f <<= minus->e - high.e;
+    minus->e = high.e;
+    *plus = high;
+}
+
+static DiyFp_t cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int index = (int) dk;
+    DiyFp_t result;
+
+    if (dk - index > 0.0)
+    {
+        index++;
+    }
+
+    index = (index >> 3) + 1;
+    *k = -(-348 + index * 8);
+
+    result.f = CachedPowersF[index];
+    result.e = CachedPowersE[index];
+
+    return result;
+}
+
+static void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits(uint32_t n)
+{
+    int digits = 1;
+
+    while (digits < 10 && n >= Power10Int[digits])
+    {
+        digits++;
+    }
+    return digits;
+}
+
+static void grisu_digits(DiyFp_t w, DiyFp_t mp, uint64_t delta, char *buffer, int *length, int *k)
+{
+    DiyFp_t one = {(uint64_t) 1 << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+
+    *length = 0;
+
+    while (kappa > 0)
+    {
+        uint32_t divisor = (uint32_t) Power10Int[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        uint64_t rest;
+
+        p1 %= divisor;
+        if (digit || *length)
+        {
+            buffer[(*length)++] = (char) ('0' + digit);
+        }
+        kappa--;
+
+        rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, rest, Power10Int[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    for (;;)
+    {
+        char digit;
+
+        p2 *= 10;
+        delta *= 10;
+        digit = (char) (p2 >> -one.e);
+        if (digit || *length)
+        {
+            buffer[(*length)++] = (char) ('0' + digit);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, p2, one.f, -kappa < 20 ? wp_w * Power10Int[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+static int write_exponent(char *buffer, int exponent)
+{
+    char *p = buffer;
+
+    *p++ = 'e';
+    if (exponent < 0)
+    {
+        *p++ = '-';
+        exponent = -exponent;
+    }
+    if (exponent >= 100)
+    {
+        *p++ = (char) ('0' + exponent / 100);
+        exponent %= 100;
+        *p++ = (char) ('0' + exponent / 10);
+    }
+    else if (exponent >= 10)
+    {
+        *p++ = (char) ('0' + exponent / 10);
+    }
+    *p++ = (char) ('0' + exponent % 10);
+
+    return (int) (p - buffer);
+}
+
+/*
+ * Place the decimal point in the digits, value = digits * 10^k
+ */
+static int prettify(char *buffer, int length, int k)
+{
+    int point = length + k;
+
+    if (k >= 0 && point <= 21)
+    {
+        /* 1234e7 -> 12340000000.0 */
+        memset(buffer + length, '0', (size_t) k);
+        buffer[point] = '.';
+        buffer[point + 1] = '0';
+        return point + 2;
+    }
+
+    if (point > 0 && point <= 21)
+    {
+        /* 1234e-2 -> 12.34 */
+        memmove(buffer + point + 1, buffer + point, (size_t) (length - point));
+        buffer[point] = '.';
+        return length + 1;
+    }
+
+    if (point > -6 && point <= 0)
+    {
+        /* 1234e-6 -> 0.001234 */
+        int offset = 2 - point;
+
+        memmove(buffer + offset, buffer, (size_t) length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', (size_t) -point);
+        return length + offset;
+    }
+
+    if (length == 1)
+    {
+        /* 1e30 */
+        return 1 + write_exponent(buffer + 1, point - 1);
+    }
+
+    /* 1234e30 -> 1.234e33 */
+    memmove(buffer + 2, buffer + 1, (size_t) (length - 1));
+    buffer[1] = '.';
+    return length + 1 + write_exponent(buffer + length + 1, point - 1);
+}
+
+static int format_shortest(char *buffer, double value)
+{
+    DiyFp_t v = diyfp_from_double(value), minus, plus, c_mk, w, wp, wm;
+    int length, k;
+
+    diyfp_boundaries(v, &minus, &plus);
+    c_mk = cached_power(plus.e, &k);
+
+    w = diyfp_multiply(diyfp_normalize(v), c_mk);
+    wp = diyfp_multiply(plus, c_mk);
+    wm = diyfp_multiply(minus, c_mk);
+    wm.f++;
+    wp.f--;
+
+    grisu_digits(w, wp, wp.f - wm.f, buffer, &length, &k);
+
+    return prettify(buffer, length, k);
+}
+
+static int write_unsigned(char *buffer, uint64_t value)
+{
+    char digits[20];
+    int length = 0;
+
+    do
+    {
+        digits[length++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    for (int i = 0; i < length; i++)
+    {
+        buffer[i] = digits[length - 1 - i];
+    }
+    return length;
+}
+
+static int format_fixed(char *buffer, double value, int precision)
+{
+    uint64_t scaled = (uint64_t) llround(value * Power10[precision]);
+    uint64_t divisor = Power10Int[precision];
+    uint64_t fraction = scaled % divisor;
+    int length = write_unsigned(buffer, scaled / divisor);
+
+    buffer[length++] = '.';
+    if (!fraction)
+    {
+        buffer[length++] = '0';
+        return length;
+    }
+
+    for (int i = precision - 1; i >= 0 && fraction; i--)
+    {
+        uint64_t digit = fraction / Power10Int[i];
+
+        buffer[length++] = (char) ('0' + digit);
+        fraction -= digit * Power10Int[i];
+    }
+
+    return length;
+}
+
+int number_format_double(char *buffer, double value, int precision)
+{
+    int sign = 0;
+
+    if (signbit(value))
+    {
+        buffer[sign++] = '-';
+        value = -value;
+    }
+
+    if (value == 0.)
+    {
+        memcpy(buffer + sign, "0.0", 3);
+        return sign + 3;
+    }
+
+    if (precision >= 0 && precision <= 15 && value * Power10[precision] < 9e15)
+    {
+        return sign + format_fixed(buffer + sign, value, precision);
+    }
+
+    return sign + format_shortest(buffer + sign, value);
+}
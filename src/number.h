@@ -0,0 +1,82 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NUMBER_H__
+#define __NUMBER_H__
+
+#include <stdint.h>
+
+/*
+ * Parse a decimal number (optional sign, fraction and exponent) starting at begin.
+ * Nothing past end is read, so the text doesn't have to be NUL terminated.
+ *
+ * @param begin: The first character of the number
+ * @param end: One past the last readable character
+ * @param value: Where to store the parsed value
+ * @return A pointer just after the number, or NULL if there's no number at begin
+ */
+const char *number_parse_double(const char *begin, const char *end, double *value);
+
+/*
+ * Parse an unsigned 32 bits integer starting at begin.
+ *
+ * @param begin: The first character of the number
+ * @param end: One past the last readable character
+ * @param value: Where to store the parsed value
+ * @return A pointer just after the number, or NULL if there's no number or it overflows
+ */
+const char *number_parse_uint32(const char *begin, const char *end, uint32_t *value);
+
+/*
+ * Format with the shortest text that reads back as the same double
+ */
+#define NUMBER_SHORTEST (-1)
+
+/*
+ * The largest text number_format_double writes, NUL included
+ */
+#define NUMBER_FORMAT_MAX 32
+
+/*
+ * Format a finite double as a JSON real (always with a decimal point or an exponent).
+ *
+ * With a precision, the value is rounded to that many decimals and the trailing
+ * zeros are dropped, which is a few integer operations. Without, it's the
+ * shortest representation that round-trips (Grisu2).
+ *
+ * @param buffer: At least NUMBER_FORMAT_MAX bytes, the text isn't NUL terminated
+ * @param value: The finite value to format
+ * @param precision: The number of decimals (0 to 15), or NUMBER_SHORTEST
+ * @return The text length
+ */
+int number_format_double(char *buffer, double value, int precision);
+
+#endif
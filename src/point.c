@@ -52,6 +52,8 @@ Point_t *point_create(double lat, double lng, char disappeared, uint32_t pk, con
     point->disappeared = disappeared;
     point->desc = desc ? strdup(desc) : NULL;
     point->pk = pk;
+    point->region = 0;
+    point->time = 0;
 
     return point;
 }
@@ -47,6 +47,8 @@ struct Point_t
 {
     LatLng_t position;
     uint32_t pk;
+    uint32_t region;
+    uint32_t time;
     char disappeared;
     char * desc;
 };
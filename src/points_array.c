@@ -32,6 +32,8 @@
 #include "points_array.h"
 #include "log.h"
 
+#include <string.h>
+
 PointArray_t *points_array_create(size_t size)
 {
     PointArray_t *arr = (PointArray_t *)malloc(sizeof(PointArray_t));
@@ -75,6 +77,64 @@ void points_array_add_point(PointArray_t *arr, Point_t *point)
     arr->position++;
 }
 
+static int compare_time(const void *a, const void *b)
+{
+    const Point_t *p = *(const Point_t **) a;
+    const Point_t *q = *(const Point_t **) b;
+
+    if (p->time != q->time)
+    {
+        return p->time < q->time ? -1 : 1;
+    }
+    return p->pk < q->pk ? -1 : p->pk > q->pk;
+}
+
+void points_array_sort_by_time(PointArray_t *arr)
+{
+    size_t i;
+
+    for (i = 0; i < arr->length && !arr->points[i]->time; i++);
+    if (i == arr->length)
+    {
+        return;
+    }
+
+    qsort(arr->points, arr->length, sizeof(Point_t *), compare_time);
+}
+
+/*
+ * The first point with a time greater or equal to the given one
+ */
+static size_t lower_bound(const PointArray_t *arr, uint64_t time)
+{
+    size_t low = 0, high = arr->length;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (arr->points[middle]->time < time)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void points_array_time_range(const PointArray_t *arr, uint32_t since, uint32_t until, PointArray_t *view)
+{
+    size_t first = since ? lower_bound(arr, since) : 0;
+    size_t last = until ? lower_bound(arr, (uint64_t) until + 1) : arr->length;
+
+    view->points = arr->points + first;
+    view->length = last > first ? last - first : 0;
+    view->position = (uint32_t) view->length;
+}
+
 void points_array_append_point(PointArray_t *arr, Point_t *point)
 {
     arr->length++;
@@ -84,3 +144,36 @@ void points_array_append_point(PointArray_t *arr, Point_t *point)
     arr->points[arr->position] = point;
     arr->position++;
 }
+
+static uint64_t digest_bytes(uint64_t digest, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        digest = (digest ^ bytes[i]) * 1099511628211ULL;
+    }
+    return digest;
+}
+
+uint64_t points_array_digest(const PointArray_t *arr, uint64_t seed)
+{
+    uint64_t digest = digest_bytes(14695981039346656037ULL, &seed, sizeof(seed));
+
+    digest = digest_bytes(digest, &arr->length, sizeof(arr->length));
+    for (size_t i = 0; i < arr->length; i++)
+    {
+        const Point_t *point = arr->points[i];
+        const char *desc = point->desc ? point->desc : "";
+
+        digest = digest_bytes(digest, &point->pk, sizeof(point->pk));
+        digest = digest_bytes(digest, &point->position.lat, sizeof(point->position.lat));
+        digest = digest_bytes(digest, &point->position.lng, sizeof(point->position.lng));
+        digest = digest_bytes(digest, &point->time, sizeof(point->time));
+        digest = digest_bytes(digest, &point->region, sizeof(point->region));
+        digest = digest_bytes(digest, &point->disappeared, sizeof(point->disappeared));
+        digest = digest_bytes(digest, desc, strlen(desc) + 1);
+    }
+
+    return digest ? digest : 1;
+}
@@ -52,4 +52,31 @@ void points_array_dispose(PointArray_t *arr);
 void points_array_add_point(PointArray_t *arr, Point_t *point);
 void points_array_append_point(PointArray_t *arr, Point_t *point);
 
+/*
+ * Sort the points by time, once at load time, so a time range is a contiguous slice.
+ * Nothing is done if no point has a time.
+ */
+void points_array_sort_by_time(PointArray_t *arr);
+
+/*
+ * Make a view on the points with since <= time <= until, without copying them.
+ * The array must be sorted by time.
+ *
+ * @param arr: The sorted points
+ * @param since: The first second, 0 for no lower bound
+ * @param until: The last second, 0 for no upper bound
+ * @param view: The array to fill, it must not be disposed
+ */
+void points_array_time_range(const PointArray_t *arr, uint32_t since, uint32_t until, PointArray_t *view);
+
+/*
+ * Hash the content of the points, in array order, so identical data gives the
+ * same value in every process.
+ *
+ * @param arr: The points
+ * @param seed: A digest of what else shapes the responses
+ * @return The FNV-1a hash, never 0
+ */
+uint64_t points_array_digest(const PointArray_t *arr, uint64_t seed);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,229 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "prefork.h"
+#include "log.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+/* A worker crashing sooner is restarted after a pause */
+#define PREFORK_MIN_LIFETIME 1
+
+static volatile sig_atomic_t Stopping = 0;
+
+static void on_stop_signal(int signal)
+{
+    (void) signal;
+    Stopping = 1;
+}
+
+/* A child wakes the master up from sigsuspend */
+static void on_child_signal(int signal)
+{
+    (void) signal;
+}
+
+/*
+ * The signals the master waits for, blocked outside of sigsuspend
+ */
+static void watched_signals(sigset_t *signals)
+{
+    sigemptyset(signals);
+    sigaddset(signals, SIGTERM);
+    sigaddset(signals, SIGINT);
+    sigaddset(signals, SIGCHLD);
+}
+
+static pid_t spawn(int index, PreforkWorker worker, void *data)
+{
+    /* The master may be PID 1 in a container, its real PID tells if it died */
+    pid_t master = getpid();
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        log_critical("Unable to fork the worker %d: %s", index, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        sigset_t signals;
+
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        watched_signals(&signals);
+        sigprocmask(SIG_UNBLOCK, &signals, NULL);
+
+        /* Never outlive the master */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != master)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        log_info("Worker %d started with PID=%d", index, getpid());
+        worker(index, data);
+        exit(EXIT_SUCCESS);
+    }
+
+    return pid;
+}
+
+void prefork_run(int workers, PreforkWorker worker, void *data)
+{
+    pid_t *pids = (pid_t *) calloc((size_t) workers, sizeof(pid_t));
+    time_t *started = (time_t *) calloc((size_t) workers, sizeof(time_t));
+    struct sigaction action;
+    sigset_t signals, previous, waiting;
+    int alive = 0, killed = 0;
+
+    if (!pids || !started)
+    {
+        log_critical("Unable to allocate %d workers", workers);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Blocked but while waiting, so a stop signal is never missed between
+     * the check of Stopping and the wait */
+    watched_signals(&signals);
+    sigprocmask(SIG_BLOCK, &signals, &previous);
+    waiting = previous;
+    sigdelset(&waiting, SIGTERM);
+    sigdelset(&waiting, SIGINT);
+    sigdelset(&waiting, SIGCHLD);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    action.sa_handler = on_child_signal;
+    sigaction(SIGCHLD, &action, NULL);
+
+    for (int i = 0; i < workers; i++)
+    {
+        started[i] = time(NULL);
+        pids[i] = spawn(i, worker, data);
+        alive++;
+    }
+
+    while (alive)
+    {
+        int status, index = -1;
+        pid_t pid;
+
+        if (Stopping && !killed)
+        {
+            log_info("Stopping the %d workers", alive);
+            for (int i = 0; i < workers; i++)
+            {
+                if (pids[i])
+                {
+                    kill(pids[i], SIGTERM);
+                }
+            }
+            killed = 1;
+        }
+
+        pid = waitpid(-1, &status, WNOHANG);
+        if (pid == 0)
+        {
+            sigsuspend(&waiting);
+            continue;
+        }
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < workers; i++)
+        {
+            if (pids[i] == pid)
+            {
+                index = i;
+            }
+        }
+        if (index < 0)
+        {
+            continue;
+        }
+        pids[index] = 0;
+        alive--;
+
+        if (Stopping)
+        {
+            continue;
+        }
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+        {
+            log_info("Worker %d exited", index);
+            continue;
+        }
+
+        if (WIFSIGNALED(status))
+        {
+            log_error("Worker %d (PID=%d) killed by signal %d, restarting it", index, pid, WTERMSIG(status));
+        }
+        else
+        {
+            log_error("Worker %d (PID=%d) exited with %d, restarting it", index, pid, WEXITSTATUS(status));
+        }
+
+        if (time(NULL) - started[index] < PREFORK_MIN_LIFETIME)
+        {
+            sleep(PREFORK_MIN_LIFETIME);
+        }
+        started[index] = time(NULL);
+        pids[index] = spawn(index, worker, data);
+        alive++;
+    }
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+    free(started);
+    free(pids);
+}
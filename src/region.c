@@ -0,0 +1,431 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "region.h"
+#include "convert.h"
+#include "common.h"
+#include "log.h"
+
+#include <jansson.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define REGION_GRID 128
+
+/* The smallest extent of the grid, in degrees, when the regions are flat */
+#define REGION_MIN_EXTENT 1e-9
+
+static void *region_alloc(size_t size)
+{
+    void *memory = calloc(1, size);
+    if (!memory)
+    {
+        log_critical("Memory error while loading the regions");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static char *region_property(json_t *feature, const char *property)
+{
+    json_t *value = json_object_get(json_object_get(feature, "properties"), property);
+    char buffer[32];
+
+    if (!value && !strcmp(property, "id"))
+    {
+        value = json_object_get(feature, "id");
+    }
+
+    if (json_is_string(value))
+    {
+        return strdup(json_string_value(value));
+    }
+    if (json_is_integer(value))
+    {
+        snprintf(buffer, sizeof(buffer), "%lld", (long long) json_integer_value(value));
+        return strdup(buffer);
+    }
+    return NULL;
+}
+
+static void region_add_ring(Region_t *region, json_t *ring)
+{
+    size_t length = json_array_size(ring);
+    LatLng_t *vertices;
+
+    if (length < 3)
+    {
+        return;
+    }
+
+    vertices = region_alloc(sizeof(LatLng_t) * length);
+    for (size_t i = 0; i < length; i++)
+    {
+        json_t *position = json_array_get(ring, i);
+
+        vertices[i].lng = json_number_value(json_array_get(position, 0));
+        vertices[i].lat = json_number_value(json_array_get(position, 1));
+
+        region->north = fmax(region->north, vertices[i].lat);
+        region->south = fmin(region->south, vertices[i].lat);
+        region->east = fmax(region->east, vertices[i].lng);
+        region->west = fmin(region->west, vertices[i].lng);
+    }
+
+    region->rings = realloc(region->rings, sizeof(LatLng_t *) * (region->rings_count + 1));
+    region->ring_lengths = realloc(region->ring_lengths, sizeof(size_t) * (region->rings_count + 1));
+    if (!region->rings || !region->ring_lengths)
+    {
+        log_critical("Memory error while loading the regions");
+        exit(EXIT_FAILURE);
+    }
+
+    region->rings[region->rings_count] = vertices;
+    region->ring_lengths[region->rings_count] = length;
+    region->rings_count++;
+}
+
+/*
+ * Keep every ring of every polygon: with the even-odd rule, holes and
+ * multi polygons need no special case.
+ */
+static int region_read_geometry(Region_t *region, json_t *geometry)
+{
+    const char *type = json_string_value(json_object_get(geometry, "type"));
+    json_t *coordinates = json_object_get(geometry, "coordinates");
+
+    region->north = region->east = -INFINITY;
+    region->south = region->west = INFINITY;
+
+    if (type && !strcmp(type, "Polygon"))
+    {
+        for (size_t i = 0; i < json_array_size(coordinates); i++)
+        {
+            region_add_ring(region, json_array_get(coordinates, i));
+        }
+    }
+    else if (type && !strcmp(type, "MultiPolygon"))
+    {
+        for (size_t i = 0; i < json_array_size(coordinates); i++)
+        {
+            json_t *polygon = json_array_get(coordinates, i);
+
+            for (size_t j = 0; j < json_array_size(polygon); j++)
+            {
+                region_add_ring(region, json_array_get(polygon, j));
+            }
+        }
+    }
+
+    return region->rings_count > 0;
+}
+
+static void region_cells(const RegionSet_t *set, const Region_t *region, int *x0, int *y0, int *x1, int *y1)
+{
+    double width = (set->east - set->west) / REGION_GRID;
+    double height = (set->north - set->south) / REGION_GRID;
+
+    *x0 = (int) ((region->west - set->west) / width);
+    *x1 = (int) ((region->east - set->west) / width);
+    *y0 = (int) ((region->south - set->south) / height);
+    *y1 = (int) ((region->north - set->south) / height);
+
+    *x0 = *x0 < 0 ? 0 : *x0;
+    *y0 = *y0 < 0 ? 0 : *y0;
+    *x1 = *x1 >= REGION_GRID ? REGION_GRID - 1 : *x1;
+    *y1 = *y1 >= REGION_GRID ? REGION_GRID - 1 : *y1;
+}
+
+static void region_build_index(RegionSet_t *set)
+{
+    uint32_t *fill;
+    int x0, y0, x1, y1;
+
+    set->north = set->east = -INFINITY;
+    set->south = set->west = INFINITY;
+    for (size_t i = 0; i < set->length; i++)
+    {
+        set->north = fmax(set->north, set->regions[i].north);
+        set->south = fmin(set->south, set->regions[i].south);
+        set->east = fmax(set->east, set->regions[i].east);
+        set->west = fmin(set->west, set->regions[i].west);
+    }
+
+    /* A single point or line would make the cells zero-sized */
+    if (set->east - set->west < REGION_MIN_EXTENT)
+    {
+        set->east = set->west + REGION_MIN_EXTENT;
+    }
+    if (set->north - set->south < REGION_MIN_EXTENT)
+    {
+        set->north = set->south + REGION_MIN_EXTENT;
+    }
+
+    /* Count the regions of every cell, then fill them */
+    set->cell_offsets = region_alloc(sizeof(uint32_t) * (REGION_GRID * REGION_GRID + 1));
+    for (size_t i = 0; i < set->length; i++)
+    {
+        region_cells(set, &set->regions[i], &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                set->cell_offsets[y * REGION_GRID + x + 1]++;
+            }
+        }
+    }
+
+    for (int cell = 0; cell < REGION_GRID * REGION_GRID; cell++)
+    {
+        set->cell_offsets[cell + 1] += set->cell_offsets[cell];
+    }
+
+    set->cell_regions = region_alloc(sizeof(uint32_t) * (set->cell_offsets[REGION_GRID * REGION_GRID] + 1));
+    fill = region_alloc(sizeof(uint32_t) * REGION_GRID * REGION_GRID);
+
+    for (size_t i = 0; i < set->length; i++)
+    {
+        region_cells(set, &set->regions[i], &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                int cell = y * REGION_GRID + x;
+                set->cell_regions[set->cell_offsets[cell] + fill[cell]++] = (uint32_t) i;
+            }
+        }
+    }
+
+    free(fill);
+}
+
+RegionSet_t *region_load(const char *filename, const char *id_property, const char *name_property)
+{
+    RegionSet_t *set;
+    json_error_t error;
+    json_t *root, *features;
+
+    root = json_load_file(filename, 0, &error);
+    if (!root)
+    {
+        log_critical("Unable to read the regions %s line %d: %s", filename, error.line, error.text);
+        exit(EXIT_FAILURE);
+    }
+
+    features = json_object_get(root, "features");
+    set = region_alloc(sizeof(RegionSet_t));
+    set->regions = region_alloc(sizeof(Region_t) * (json_array_size(features) + 1));
+
+    for (size_t i = 0; i < json_array_size(features); i++)
+    {
+        json_t *feature = json_array_get(features, i);
+        Region_t *region = &set->regions[set->length];
+
+        if (!region_read_geometry(region, json_object_get(feature, "geometry")))
+        {
+            log_warning("The region feature %zu has no polygon", i);
+            continue;
+        }
+
+        region->id = region_property(feature, id_property);
+        region->name = region_property(feature, name_property);
+        set->length++;
+    }
+
+    json_decref(root);
+
+    if (set->length)
+    {
+        region_build_index(set);
+    }
+
+    log_info("Loaded %zu regions from %s", set->length, filename);
+
+    return set;
+}
+
+void region_dispose(RegionSet_t *set)
+{
+    if (!set)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < set->length; i++)
+    {
+        for (size_t j = 0; j < set->regions[i].rings_count; j++)
+        {
+            DELETE(set->regions[i].rings[j]);
+        }
+        DELETE(set->regions[i].rings);
+        DELETE(set->regions[i].ring_lengths);
+        DELETE(set->regions[i].id);
+        DELETE(set->regions[i].name);
+    }
+
+    DELETE(set->regions);
+    DELETE(set->cell_offsets);
+    DELETE(set->cell_regions);
+    DELETE(set);
+}
+
+uint64_t region_digest(const RegionSet_t *set)
+{
+    uint64_t digest = 14695981039346656037ULL;
+
+    if (!set)
+    {
+        return 0;
+    }
+
+    /* FNV-1a over the count and the ids, in loading order */
+    digest = (digest ^ set->length) * 1099511628211ULL;
+    for (size_t i = 0; i < set->length; i++)
+    {
+        for (const char *c = set->regions[i].id ? set->regions[i].id : ""; *c; c++)
+        {
+            digest = (digest ^ (unsigned char) *c) * 1099511628211ULL;
+        }
+        digest = (digest ^ 0xff) * 1099511628211ULL;
+    }
+
+    return digest ? digest : 1;
+}
+
+static int region_contains(const Region_t *region, double lat, double lng)
+{
+    int inside = 0;
+
+    if (lat < region->south || lat > region->north || lng < region->west || lng > region->east)
+    {
+        return 0;
+    }
+
+    for (size_t r = 0; r < region->rings_count; r++)
+    {
+        const LatLng_t *ring = region->rings[r];
+        size_t length = region->ring_lengths[r];
+
+        for (size_t i = 0, j = length - 1; i < length; j = i++)
+        {
+            if ((ring[i].lat > lat) != (ring[j].lat > lat) &&
+                lng < (ring[j].lng - ring[i].lng) * (lat - ring[i].lat) / (ring[j].lat - ring[i].lat) + ring[i].lng)
+            {
+                inside = !inside;
+            }
+        }
+    }
+
+    return inside;
+}
+
+uint32_t region_find(const RegionSet_t *set, double lat, double lng)
+{
+    int x, y, cell;
+
+    if (!set->length || lat < set->south || lat > set->north || lng < set->west || lng > set->east)
+    {
+        return REGION_NONE;
+    }
+
+    x = (int) ((lng - set->west) / (set->east - set->west) * REGION_GRID);
+    y = (int) ((lat - set->south) / (set->north - set->south) * REGION_GRID);
+    cell = (y >= REGION_GRID ? REGION_GRID - 1 : y) * REGION_GRID + (x >= REGION_GRID ? REGION_GRID - 1 : x);
+
+    for (uint32_t i = set->cell_offsets[cell]; i < set->cell_offsets[cell + 1]; i++)
+    {
+        uint32_t index = set->cell_regions[i];
+
+        if (region_contains(&set->regions[index], lat, lng))
+        {
+            return index + 1;
+        }
+    }
+
+    return REGION_NONE;
+}
+
+void region_assign(const RegionSet_t *set, PointArray_t *points_array)
+{
+    size_t assigned = 0;
+
+    for (size_t i = 0; i < points_array->length; i++)
+    {
+        Point_t *point = points_array->points[i];
+
+        point->region = region_find(set, convert_lat_to_gps(point->position.lat),
+                                    convert_lng_to_gps(point->position.lng));
+        assigned += point->region != REGION_NONE;
+    }
+
+    log_info("%zu of %zu points are in a region", assigned, points_array->length);
+}
+
+RegionCount_t *region_aggregate(const RegionSet_t *set, PointArray_t *points_array, Bound_t bounds)
+{
+    RegionCount_t *counts = region_alloc(sizeof(RegionCount_t) * (set->length + 1));
+    double north = convert_lat_from_gps(bounds.north);
+    double south = convert_lat_from_gps(bounds.south);
+    double east = convert_lng_from_gps(bounds.east);
+    double west = convert_lng_from_gps(bounds.west);
+
+    /* Same bounds test as the clustering, in converted degrees */
+    for (size_t i = 0; i < points_array->length; i++)
+    {
+        const Point_t *point = points_array->points[i];
+        RegionCount_t *count;
+
+        if (point->region == REGION_NONE || point->region > set->length ||
+            point->position.lat < north || point->position.lat > south ||
+            point->position.lng < west || point->position.lng > east)
+        {
+            continue;
+        }
+
+        count = &counts[point->region - 1];
+        count->count++;
+        count->disappeared += point->disappeared != 0;
+        count->lat += point->position.lat;
+        count->lng += point->position.lng;
+    }
+
+    for (size_t i = 0; i < set->length; i++)
+    {
+        if (counts[i].count)
+        {
+            counts[i].lat = convert_lat_to_gps(counts[i].lat / counts[i].count);
+            counts[i].lng = convert_lng_to_gps(counts[i].lng / counts[i].count);
+        }
+    }
+
+    return counts;
+}
@@ -0,0 +1,123 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __REGION_H__
+#define __REGION_H__
+
+#include "points_array.h"
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGION_NONE 0
+
+typedef struct Region_t
+{
+    char *id;
+    char *name;
+    double north, south, east, west;
+
+    LatLng_t **rings;
+    size_t *ring_lengths;
+    size_t rings_count;
+} Region_t;
+
+/*
+ * The regions and a uniform grid over their bounding box. Each cell of the
+ * grid lists the regions overlapping it, so a lookup only tests a few polygons.
+ */
+typedef struct RegionSet_t
+{
+    Region_t *regions;
+    size_t length;
+
+    double north, south, east, west;
+    uint32_t *cell_offsets;
+    uint32_t *cell_regions;
+} RegionSet_t;
+
+/*
+ * The aggregation of the points of one region
+ */
+typedef struct RegionCount_t
+{
+    uint32_t count;
+    uint32_t disappeared;
+    double lat, lng;
+} RegionCount_t;
+
+/*
+ * Load the Polygon and MultiPolygon features of a GeoJSON file.
+ *
+ * @param filename: The GeoJSON file
+ * @param id_property: The feature property used as region id
+ * @param name_property: The feature property used as region name
+ * @return The regions and their index
+ */
+RegionSet_t *region_load(const char *filename, const char *id_property, const char *name_property);
+
+/*
+ * Dispose the regions
+ */
+void region_dispose(RegionSet_t *set);
+
+/*
+ * The identity of the regions: their count and ids in loading order. It is
+ * stored with the shared points, whose region numbers depend on it.
+ *
+ * @return 0 without regions
+ */
+uint64_t region_digest(const RegionSet_t *set);
+
+/*
+ * Find the region of a GPS position.
+ *
+ * @return The region number (index + 1) or REGION_NONE
+ */
+uint32_t region_find(const RegionSet_t *set, double lat, double lng);
+
+/*
+ * Store the region number in every point, once at load time
+ */
+void region_assign(const RegionSet_t *set, PointArray_t *points_array);
+
+/*
+ * Count the points of each region in the bounds and compute their barycenters.
+ *
+ * @param set: The regions
+ * @param points_array: The points with their region assigned
+ * @param bounds: The GPS bounds of the view
+ * @return An array of set->length counts, in GPS degrees
+ */
+RegionCount_t *region_aggregate(const RegionSet_t *set, PointArray_t *points_array, Bound_t bounds);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "response_cache.h"
+#include "common.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t response_cache_hash(const char *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (const unsigned char *p = (const unsigned char *) key; *p; p++)
+    {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static CacheShard_t *response_cache_shard(ResponseCache_t *cache, uint64_t hash)
+{
+    /* The high bits, the low ones choose the bucket */
+    return &cache->shards[(hash >> 40) % cache->shards_count];
+}
+
+void response_cache_lock(ResponseCache_t *cache, const char *key)
+{
+    if (cache)
+    {
+        pthread_mutex_lock(&response_cache_shard(cache, response_cache_hash(key))->lock);
+    }
+}
+
+void response_cache_unlock(ResponseCache_t *cache, const char *key)
+{
+    if (cache)
+    {
+        pthread_mutex_unlock(&response_cache_shard(cache, response_cache_hash(key))->lock);
+    }
+}
+
+ResponseCache_t *response_cache_create(size_t length, size_t disk_min_size, const char *directory)
+{
+    ResponseCache_t *cache = (ResponseCache_t *) malloc(sizeof(ResponseCache_t));
+
+    if (!cache)
+    {
+        log_critical("Unable to allocate the response cache");
+        exit(EXIT_FAILURE);
+    }
+
+    cache->shards_count = length < RESPONSE_CACHE_SHARDS ? length : RESPONSE_CACHE_SHARDS;
+    cache->shards = (CacheShard_t *) calloc(cache->shards_count, sizeof(CacheShard_t));
+    if (!cache->shards)
+    {
+        log_critical("Unable to allocate the response cache");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < cache->shards_count; i++)
+    {
+        CacheShard_t *shard = &cache->shards[i];
+        size_t buckets = 1;
+
+        shard->length = length / cache->shards_count + (i < length % cache->shards_count);
+        while (buckets < shard->length)
+        {
+            buckets <<= 1;
+        }
+
+        shard->entries = (CacheEntry_t *) calloc(shard->length, sizeof(CacheEntry_t));
+        shard->buckets = (CacheEntry_t **) calloc(buckets, sizeof(CacheEntry_t *));
+        if (!shard->entries || !shard->buckets)
+        {
+            log_critical("Unable to allocate %zu responses in the cache", length);
+            exit(EXIT_FAILURE);
+        }
+        shard->mask = buckets - 1;
+        shard->clock = 0;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+
+    cache->disk_min_size = disk_min_size;
+    cache->directory = directory ? strdup(directory) : NULL;
+
+    return cache;
+}
+
+void response_cache_entry_dispose(CacheEntry_t *entry)
+{
+    DELETE(entry->key);
+    entry->key = NULL;
+    for (int i = 0; i < ENCODING_COUNT; i++)
+    {
+        body_release(entry->bodies[i]);
+        entry->bodies[i] = NULL;
+    }
+}
+
+void response_cache_dispose(ResponseCache_t *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < cache->shards_count; i++)
+    {
+        CacheShard_t *shard = &cache->shards[i];
+
+        for (size_t j = 0; j < shard->length; j++)
+        {
+            response_cache_entry_dispose(&shard->entries[j]);
+        }
+        free(shard->entries);
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(cache->shards);
+    DELETE(cache->directory);
+    free(cache);
+}
+
+CacheEntry_t *response_cache_find(ResponseCache_t *cache, const char *key)
+{
+    CacheShard_t *shard;
+    uint64_t hash;
+
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    hash = response_cache_hash(key);
+    shard = response_cache_shard(cache, hash);
+    for (CacheEntry_t *entry = shard->buckets[hash & shard->mask]; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && !strcmp(entry->key, key))
+        {
+            entry->last_use = ++shard->clock;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Take an entry out of its bucket before it gets another key
+ */
+static void response_cache_unlink(CacheShard_t *shard, CacheEntry_t *entry)
+{
+    CacheEntry_t **link = &shard->buckets[entry->hash & shard->mask];
+
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->next = NULL;
+}
+
+CacheEntry_t *response_cache_insert(ResponseCache_t *cache, const char *key, const char *content_type)
+{
+    CacheEntry_t *entry = response_cache_find(cache, key);
+    uint64_t hash = response_cache_hash(key);
+    CacheShard_t *shard = response_cache_shard(cache, hash);
+
+    /* Computed twice by requests that missed the cache at the same time */
+    if (entry)
+    {
+        for (int i = 0; i < ENCODING_COUNT; i++)
+        {
+            body_release(entry->bodies[i]);
+            entry->bodies[i] = NULL;
+        }
+        entry->content_type = content_type;
+        return entry;
+    }
+
+    /* A miss has just computed the response, the scan is not on the hit path */
+    entry = &shard->entries[0];
+    for (size_t i = 1; i < shard->length && entry->key; i++)
+    {
+        if (!shard->entries[i].key || shard->entries[i].last_use < entry->last_use)
+        {
+            entry = &shard->entries[i];
+        }
+    }
+
+    if (entry->key)
+    {
+        response_cache_unlink(shard, entry);
+    }
+    response_cache_entry_dispose(entry);
+    entry->key = strdup(key);
+    entry->hash = hash;
+    entry->last_use = ++shard->clock;
+    entry->content_type = content_type;
+    entry->next = shard->buckets[hash & shard->mask];
+    shard->buckets[hash & shard->mask] = entry;
+
+    return entry;
+}
+
+Body_t *response_cache_set_body(ResponseCache_t *cache, CacheEntry_t *entry, Encoding_t encoding,
+                                struct evbuffer *content)
+{
+    int on_disk = cache->disk_min_size && cache->directory && evbuffer_get_length(content) >= cache->disk_min_size;
+
+    body_release(entry->bodies[encoding]);
+    entry->bodies[encoding] = body_create(content, on_disk ? cache->directory : NULL);
+
+    return entry->bodies[encoding];
+}
@@ -0,0 +1,164 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RESPONSE_CACHE_H__
+#define __RESPONSE_CACHE_H__
+
+#include "body.h"
+#include "compression.h"
+
+#include <event2/buffer.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The loops lock one shard at a time, chosen by the hash of the key */
+#define RESPONSE_CACHE_SHARDS 16
+
+/*
+ * A response, with the bodies of the encodings computed so far
+ */
+typedef struct CacheEntry_t
+{
+    char *key;
+    uint64_t hash;
+    uint64_t last_use;
+    const char *content_type;
+    Body_t *bodies[ENCODING_COUNT];
+
+    /* The next entry of the same bucket */
+    struct CacheEntry_t *next;
+} CacheEntry_t;
+
+/*
+ * A part of the responses with its lock, and their index by hash
+ */
+typedef struct
+{
+    CacheEntry_t *entries;
+    size_t length;
+    CacheEntry_t **buckets;
+    size_t mask;
+    uint64_t clock;
+    pthread_mutex_t lock;
+} CacheShard_t;
+
+/*
+ * The last used responses. The points never change once loaded, so an entry
+ * only leaves the cache to make room for another one.
+ */
+typedef struct
+{
+    CacheShard_t *shards;
+    size_t shards_count;
+    size_t disk_min_size;
+    char *directory;
+} ResponseCache_t;
+
+/*
+ * Hash a key, FNV-1a
+ *
+ * @param key: The normalized request
+ * @return The hash
+ */
+uint64_t response_cache_hash(const char *key);
+
+/*
+ * Lock the shard of a key, its entries are only valid until it is unlocked.
+ * The other functions only use the entries of the locked key.
+ *
+ * @param cache: The cache, or NULL
+ * @param key: The normalized request
+ */
+void response_cache_lock(ResponseCache_t *cache, const char *key);
+
+/*
+ * Unlock the shard of a key
+ *
+ * @param cache: The cache, or NULL
+ * @param key: The normalized request
+ */
+void response_cache_unlock(ResponseCache_t *cache, const char *key);
+
+/*
+ * Create the cache
+ *
+ * @param length: The number of responses to keep, spread over the shards
+ * @param disk_min_size: The bodies of this size or more are kept in files, 0 never
+ * @param directory: Where to create the files
+ * @return The cache
+ */
+ResponseCache_t *response_cache_create(size_t length, size_t disk_min_size, const char *directory);
+
+/*
+ * Dispose the cache and its responses
+ */
+void response_cache_dispose(ResponseCache_t *cache);
+
+/*
+ * Find a response
+ *
+ * @param cache: The cache, may be NULL
+ * @param key: The normalized request
+ * @return The entry, NULL if it isn't in the cache
+ */
+CacheEntry_t *response_cache_find(ResponseCache_t *cache, const char *key);
+
+/*
+ * Add a response without body, in place of the least recently used one. A
+ * response of the same key loses its bodies and is returned instead.
+ *
+ * @param cache: The cache
+ * @param key: The normalized request
+ * @param content_type: The static content type of the bodies
+ * @return The entry
+ */
+CacheEntry_t *response_cache_insert(ResponseCache_t *cache, const char *key, const char *content_type);
+
+/*
+ * Set a body of a response
+ *
+ * @param cache: The cache
+ * @param entry: The entry
+ * @param encoding: The encoding of the body
+ * @param content: The body content, emptied
+ * @return The body, owned by the entry
+ */
+Body_t *response_cache_set_body(ResponseCache_t *cache, CacheEntry_t *entry, Encoding_t encoding,
+                                struct evbuffer *content);
+
+/*
+ * Release the key and the bodies of an entry. The responses being sent keep
+ * their own reference on the bodies.
+ */
+void response_cache_entry_dispose(CacheEntry_t *entry);
+
+#endif
@@ -30,18 +30,30 @@
  */
 
 #include "server.h"
+#include "server_uring.h"
 #include "log.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
 
-Server_t *server_create(char *address, uint16_t port)
+Server_t *server_create(char *address, uint16_t port, int workers)
 {
     Server_t *server = NULL;
 
+    if (workers <= 0)
+    {
+        workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        workers = workers > 0 ? workers : 1;
+    }
+
     server = (Server_t *) malloc(sizeof(Server_t));
     if (!server)
     {
@@ -49,10 +61,37 @@ Server_t *server_create(char *address, uint16_t port)
         exit(EXIT_FAILURE);
     }
 
+    server->workers = (ServerWorker_t *) calloc((size_t) workers, sizeof(ServerWorker_t));
+    if (!server->workers)
+    {
+        log_critical("Unable to allocate %d server workers", workers);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The cached bodies go to the buffers of every loop, and the compute
+     * threads wake the loops up */
+    if (evthread_use_pthreads())
+    {
+        log_critical("Unable to enable the threads in libevent");
+        exit(EXIT_FAILURE);
+    }
+
     server->address = address;
     server->port = port;
-    server->base = event_base_new();
-    server->http = evhttp_new(server->base);
+    server->socket = -1;
+    server->unix_socket = -1;
+    server->tcp = 1;
+    server->backend = SERVER_BACKEND_LIBEVENT;
+    server->cpus = NULL;
+    server->first_cpu = 0;
+    server->routes_count = 0;
+    server->workers_count = (size_t) workers;
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        server->workers[i].base = event_base_new();
+        server->workers[i].http = evhttp_new(server->workers[i].base);
+    }
+    server->prefix_routes_count = 0;
 
     return server;
 }
@@ -61,31 +100,305 @@ void server_dispose(Server_t *server)
 {
     if (server)
     {
-        event_base_free(server->base);
-        evhttp_free(server->http);
+        for (size_t i = 0; i < server->workers_count; i++)
+        {
+            evhttp_free(server->workers[i].http);
+            event_base_free(server->workers[i].base);
+        }
+        free(server->workers);
 
         if (server->address)
         {
             free(server->address);
+        }
+
+        if (server->socket >= 0)
+        {
+            close(server->socket);
+        }
 
-            if (server->socket)
-            {
-                close(server->socket);
-            }
+        if (server->unix_socket >= 0)
+        {
+            close(server->unix_socket);
         }
 
         free(server);
     }
 }
 
+int server_listen(const char *address, uint16_t port, int reuse_port)
+{
+    struct evutil_addrinfo hints;
+    struct evutil_addrinfo *info = NULL;
+    evutil_socket_t fd;
+    char service[8];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = EVUTIL_AI_PASSIVE | EVUTIL_AI_ADDRCONFIG;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (evutil_getaddrinfo(address, service, &hints, &info))
+    {
+        log_critical("Unable to resolve the address %s", address);
+        exit(EXIT_FAILURE);
+    }
+
+    fd = socket(info->ai_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0 || evutil_make_listen_socket_reuseable(fd) ||
+        (reuse_port && evutil_make_listen_socket_reuseable_port(fd)) || evutil_make_socket_nonblocking(fd) ||
+        evutil_make_socket_closeonexec(fd) || bind(fd, info->ai_addr, info->ai_addrlen) || listen(fd, 128))
+    {
+        log_critical("Unable to listen the port %d: %s", port, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    evutil_freeaddrinfo(info);
+
+    return fd;
+}
+
+int server_listen_unix(const char *path)
+{
+    struct sockaddr_un address;
+    struct stat status;
+    evutil_socket_t fd;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        log_critical("The socket path %s is too long", path);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    /* Left by a previous run, a regular file is not removed */
+    if (!lstat(path, &status) && S_ISSOCK(status.st_mode))
+    {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || evutil_make_socket_nonblocking(fd) || evutil_make_socket_closeonexec(fd) ||
+        bind(fd, (struct sockaddr *) &address, sizeof(address)) || listen(fd, 128))
+    {
+        log_critical("Unable to listen the socket %s: %s", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+void server_set_unix_socket(Server_t *server, int socket, int tcp)
+{
+    server->unix_socket = socket;
+    server->tcp = tcp;
+}
+
+void server_set_socket(Server_t *server, int socket)
+{
+    server->socket = socket;
+}
+
+void server_set_backend(Server_t *server, ServerBackend_t backend)
+{
+    server->backend = backend;
+}
+
+void server_set_affinity(Server_t *server, const CpuList_t *cpus, size_t process)
+{
+    server->cpus = cpus;
+    server->first_cpu = process * server->workers_count;
+}
+
+static const char *request_find_header(ServerExchange_t *exchange, const char *name)
+{
+    return evhttp_find_header(evhttp_request_get_input_headers(exchange->request), name);
+}
+
+static void request_add_header(ServerExchange_t *exchange, const char *name, const char *value)
+{
+    evhttp_add_header(evhttp_request_get_output_headers(exchange->request), name, value);
+}
+
+static void request_send_reply(ServerExchange_t *exchange, int code, const char *reason, struct evbuffer *body)
+{
+    evhttp_send_reply(exchange->request, code, reason, body);
+}
+
+void server_exchange_from_request(ServerExchange_t *exchange, struct evhttp_request *req)
+{
+    const struct evhttp_uri *uri = evhttp_request_get_evhttp_uri(req);
+    char *host = NULL;
+    ev_uint16_t port = 0;
+
+    evhttp_connection_get_peer(evhttp_request_get_connection(req), &host, &port);
+
+    exchange->uri = evhttp_request_get_uri(req);
+    exchange->path = evhttp_uri_get_path(uri);
+    exchange->query = evhttp_uri_get_query(uri);
+    exchange->remote_host = host;
+    exchange->request = req;
+    exchange->find_header = request_find_header;
+    exchange->add_header = request_add_header;
+    exchange->send_reply = request_send_reply;
+    exchange->transport = NULL;
+}
+
+const char *server_find_header(ServerExchange_t *exchange, const char *name)
+{
+    return exchange->find_header(exchange, name);
+}
+
+void server_add_header(ServerExchange_t *exchange, const char *name, const char *value)
+{
+    exchange->add_header(exchange, name, value);
+}
+
+void server_send_reply(ServerExchange_t *exchange, int code, const char *reason, struct evbuffer *body)
+{
+    exchange->send_reply(exchange, code, reason, body);
+}
+
+void server_dispatch(Server_t *server, ServerExchange_t *exchange)
+{
+    const char *path = exchange->path;
+
+    for (size_t i = 0; path && i < server->routes_count; i++)
+    {
+        if (!strcmp(path, server->routes[i].path))
+        {
+            server->routes[i].callback(exchange, server->routes[i].data);
+            return;
+        }
+    }
+
+    for (size_t i = 0; path && i < server->prefix_routes_count; i++)
+    {
+        ServerRoute_t *route = &server->prefix_routes[i];
+
+        if (!strncmp(path, route->path, strlen(route->path)))
+        {
+            route->callback(exchange, route->data);
+            return;
+        }
+    }
+
+    server_send_reply(exchange, 404, "Not Found", NULL);
+}
+
+/*
+ * The exact routes, matched by libevent
+ */
+static void on_route(struct evhttp_request *req, void *data)
+{
+    ServerRoute_t *route = (ServerRoute_t *) data;
+    ServerExchange_t exchange;
+
+    server_exchange_from_request(&exchange, req);
+    route->callback(&exchange, route->data);
+}
+
 void server_add_route(Server_t *server, const char *path, ServerCallback callback, void *data)
 {
-    evhttp_set_cb(server->http, path, callback, data);
+    ServerRoute_t *route = NULL;
+
+    if (server->routes_count == SERVER_ROUTES_MAX)
+    {
+        log_critical("Too many routes, %s is one too many", path);
+        exit(EXIT_FAILURE);
+    }
+
+    route = &server->routes[server->routes_count];
+    route->path = path;
+    route->callback = callback;
+    route->data = data;
+    server->routes_count++;
+
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        evhttp_set_cb(server->workers[i].http, path, on_route, route);
+    }
 }
 
-void server_run(Server_t *server)
+/*
+ * Dispatch the requests without exact route to the prefix routes, or reply 404
+ */
+static void on_prefix_route(struct evhttp_request *req, void *data)
+{
+    ServerExchange_t exchange;
+
+    server_exchange_from_request(&exchange, req);
+    server_dispatch((Server_t *) data, &exchange);
+}
+
+void server_add_prefix_route(Server_t *server, const char *prefix, ServerCallback callback, void *data)
+{
+    if (server->prefix_routes_count == SERVER_PREFIX_ROUTES_MAX)
+    {
+        log_critical("Too many prefix routes, %s is one too many", prefix);
+        exit(EXIT_FAILURE);
+    }
+
+    server->prefix_routes[server->prefix_routes_count].path = prefix;
+    server->prefix_routes[server->prefix_routes_count].callback = callback;
+    server->prefix_routes[server->prefix_routes_count].data = data;
+    server->prefix_routes_count++;
+
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        evhttp_set_gencb(server->workers[i].http, on_prefix_route, server);
+    }
+}
+
+/*
+ * Listen the port with its own socket, the kernel shares the connections
+ * between the workers (SO_REUSEPORT)
+ */
+static struct evhttp_bound_socket *bind_reuseport(ServerWorker_t *worker, const char *address, uint16_t port)
+{
+    struct evutil_addrinfo hints;
+    struct evutil_addrinfo *info = NULL;
+    struct evconnlistener *listener = NULL;
+    char service[8];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = EVUTIL_AI_PASSIVE | EVUTIL_AI_ADDRCONFIG;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (evutil_getaddrinfo(address, service, &hints, &info))
+    {
+        return NULL;
+    }
+
+    listener = evconnlistener_new_bind(worker->base, NULL, NULL,
+                                       LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT | LEV_OPT_CLOSE_ON_FREE |
+                                       LEV_OPT_CLOSE_ON_EXEC, -1, info->ai_addr, (int) info->ai_addrlen);
+    evutil_freeaddrinfo(info);
+
+    return listener ? evhttp_bind_listener(worker->http, listener) : NULL;
+}
+
+static void *run_worker(void *data)
+{
+    ServerWorker_t *worker = (ServerWorker_t *) data;
+
+    event_base_dispatch(worker->base);
+
+    return NULL;
+}
+
+/*
+ * Display the address a TCP socket is listening on
+ */
+static void log_bound_address(struct evhttp_bound_socket *handle)
 {
-    struct evhttp_bound_socket *handle;
     char uri_root[512];
     struct sockaddr_storage addr_storage;
     evutil_socket_t fd;
@@ -95,18 +408,6 @@ void server_run(Server_t *server)
     void *inaddr;
     const char *addr;
 
-
-    log_info("Try to acquire the socket at %s:%d", server->address, server->port);
-
-    handle = evhttp_bind_socket_with_handle(server->http, server->address, server->port);
-    if (!handle)
-    {
-        log_critical("Unable to listen the port %d", server->port);
-        exit(EXIT_FAILURE);
-    }
-
-    /* Extract and display the address we're listening on. */
-
     fd = evhttp_bound_socket_get_fd(handle);
     memset(&addr_storage, 0, sizeof(addr_storage));
 
@@ -140,6 +441,90 @@ void server_run(Server_t *server)
 
     log_info("Listening on %s:%d", addr, got_port);
     evutil_snprintf(uri_root, sizeof(uri_root), "http://%s:%d", addr, got_port);
+}
+
+void server_run(Server_t *server)
+{
+    struct evhttp_bound_socket *handle = NULL;
+
+    /* A reply to a client that reset the connection fails with EPIPE instead */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (server->backend == SERVER_BACKEND_IO_URING)
+    {
+        if (server_uring_run(server))
+        {
+            return;
+        }
+        log_warning("The io_uring backend is not available, serving with libevent");
+    }
+
+    if (server->tcp)
+    {
+        log_info("Try to acquire the socket at %s:%d", server->address, server->port);
+    }
+
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        struct evhttp_bound_socket *bound = NULL;
+
+        /* The proxies on the host, the listener closes its descriptor when freed */
+        if (server->unix_socket >= 0 &&
+            !evhttp_accept_socket_with_handle(server->workers[i].http, dup(server->unix_socket)))
+        {
+            log_critical("Unable to accept the connections of the Unix socket");
+            exit(EXIT_FAILURE);
+        }
 
-    event_base_dispatch(server->base);
+        if (!server->tcp)
+        {
+            continue;
+        }
+
+        if (server->socket >= 0)
+        {
+            /* The listener closes its descriptor when freed */
+            bound = evhttp_accept_socket_with_handle(server->workers[i].http, dup(server->socket));
+        }
+        else if (server->workers_count == 1)
+        {
+            bound = evhttp_bind_socket_with_handle(server->workers[i].http, server->address, server->port);
+        }
+        else
+        {
+            bound = bind_reuseport(&server->workers[i], server->address, server->port);
+        }
+
+        if (!bound)
+        {
+            log_critical("Unable to listen the port %d", server->port);
+            exit(EXIT_FAILURE);
+        }
+        handle = handle ? handle : bound;
+    }
+
+    if (handle)
+    {
+        log_bound_address(handle);
+    }
+
+    log_info("Serving with %zu workers", server->workers_count);
+    for (size_t i = 1; i < server->workers_count; i++)
+    {
+        if (pthread_create(&server->workers[i].thread, NULL, run_worker, &server->workers[i]))
+        {
+            log_critical("Unable to start the server worker %zu", i);
+            exit(EXIT_FAILURE);
+        }
+        affinity_pin(server->workers[i].thread, server->cpus, server->first_cpu + i);
+    }
+
+    affinity_pin(pthread_self(), server->cpus, server->first_cpu);
+    run_worker(&server->workers[0]);
+
+    for (size_t i = 1; i < server->workers_count; i++)
+    {
+        event_base_loopexit(server->workers[i].base, NULL);
+        pthread_join(server->workers[i].thread, NULL);
+    }
 }
@@ -32,26 +32,146 @@
 #ifndef __SERVER_H__
 #define __SERVER_H__
 
+#include "affinity.h"
+
+#include <event2/buffer.h>
 #include <event2/http.h>
+#include <pthread.h>
 #include <stdint.h>
 
-typedef void (*ServerCallback)(struct evhttp_request *request, void * data);
+typedef struct ServerExchange_t ServerExchange_t;
+
+/*
+ * A request and its reply, whatever the network backend
+ */
+struct ServerExchange_t
+{
+    const char *uri;
+    const char *path;
+    const char *query;
+    const char *remote_host;
+
+    /* The libevent request, NULL with the io_uring backend */
+    struct evhttp_request *request;
+
+    const char *(*find_header)(ServerExchange_t *exchange, const char *name);
+    void (*add_header)(ServerExchange_t *exchange, const char *name, const char *value);
+    void (*send_reply)(ServerExchange_t *exchange, int code, const char *reason, struct evbuffer *body);
+    void *transport;
+};
+
+typedef void (*ServerCallback)(ServerExchange_t *exchange, void * data);
+
+#define SERVER_ROUTES_MAX 8
+#define SERVER_PREFIX_ROUTES_MAX 8
+
+typedef struct
+{
+    const char *path;
+    ServerCallback callback;
+    void *data;
+} ServerRoute_t;
+
+typedef enum
+{
+    SERVER_BACKEND_LIBEVENT,
+    SERVER_BACKEND_IO_URING,
+} ServerBackend_t;
+
+/* One event loop and its HTTP server, in its own thread */
+typedef struct
+{
+    struct event_base *base;
+    struct evhttp * http;
+    pthread_t thread;
+} ServerWorker_t;
 
 typedef struct
 {
     uint16_t port;
     int socket;
+    int unix_socket;
+    int tcp;
     char *address;
 
-    struct event_base *base;
-    struct evhttp * http;
+    ServerWorker_t *workers;
+    size_t workers_count;
+    ServerBackend_t backend;
+    const CpuList_t *cpus;
+    size_t first_cpu;
+
+    ServerRoute_t routes[SERVER_ROUTES_MAX];
+    size_t routes_count;
+    ServerRoute_t prefix_routes[SERVER_PREFIX_ROUTES_MAX];
+    size_t prefix_routes_count;
 
 } Server_t;
 
 /*
  * Create the server structure
+ *
+ * @param address: The address to listen
+ * @param port: The port to listen
+ * @param workers: The number of event loops sharing the port, 0 for one per CPU
+ */
+Server_t *server_create(char *address, uint16_t port, int workers);
+
+/*
+ * Open a listening socket before the server is created, to share it with
+ * forked processes
+ *
+ * @param address: The address to listen
+ * @param port: The port to listen
+ * @param reuse_port: Let other sockets listen the port too (SO_REUSEPORT)
+ * @return The socket
+ */
+int server_listen(const char *address, uint16_t port, int reuse_port);
+
+/*
+ * Listen a Unix domain socket, a previous socket file at the path is
+ * replaced
+ *
+ * @param path: The socket file
+ * @return The socket
+ */
+int server_listen_unix(const char *path);
+
+/*
+ * Accept the connections of a Unix domain socket too. Every worker accepts
+ * from it.
+ *
+ * @param server: The server object
+ * @param socket: The socket of server_listen_unix, closed with the server
+ * @param tcp: Listen the TCP port too
  */
-Server_t *server_create(char *address, uint16_t port);
+void server_set_unix_socket(Server_t *server, int socket, int tcp);
+
+/*
+ * Accept the connections of a listening socket instead of binding the port.
+ * Every worker accepts from it.
+ *
+ * @param server: The server object
+ * @param socket: The socket of server_listen, closed with the server
+ */
+void server_set_socket(Server_t *server, int socket);
+
+/*
+ * Serve with io_uring instead of libevent. It falls back to libevent when
+ * it is not built or not allowed by the kernel.
+ *
+ * @param server: The server object
+ * @param backend: The network backend
+ */
+void server_set_backend(Server_t *server, ServerBackend_t backend);
+
+/*
+ * Pin the workers, one CPU each
+ *
+ * @param server: The server object
+ * @param cpus: The CPUs, taken in turn, they must live longer than the server
+ * @param process: The rank of the process, its workers take the CPUs after those of the previous ones
+ */
+void server_set_affinity(Server_t *server, const CpuList_t *cpus, size_t process);
 
 /*
  * Dispose the server structure  and dispose allocated memory.
@@ -70,7 +190,61 @@ void server_dispose(Server_t *server);
 void server_add_route(Server_t *server, const char *path, ServerCallback callback, void *data);
 
 /*
- * Run the server.
+ * Add a route for every URL starting with a prefix, when no exact route matches
+ *
+ * @param server: The server object
+ * @param prefix: The beginning of the path (/tiles/)
+ * @param callback: The callback when the uri match
+ * @param data: The user data
+ */
+void server_add_prefix_route(Server_t *server, const char *prefix, ServerCallback callback, void *data);
+
+/*
+ * Call the route of a request, or reply 404
+ *
+ * @param server: The server object
+ * @param exchange: The request
+ */
+void server_dispatch(Server_t *server, ServerExchange_t *exchange);
+
+/*
+ * Wrap a libevent request
+ *
+ * @param exchange: The exchange to fill
+ * @param req: The request, it must live longer than the exchange
+ */
+void server_exchange_from_request(ServerExchange_t *exchange, struct evhttp_request *req);
+
+/*
+ * Find a header of the request
+ *
+ * @param exchange: The request
+ * @param name: The header name, case insensitive
+ * @return The value, or NULL
+ */
+const char *server_find_header(ServerExchange_t *exchange, const char *name);
+
+/*
+ * Add a header to the reply
+ *
+ * @param exchange: The request
+ * @param name: The header name
+ * @param value: The header value
+ */
+void server_add_header(ServerExchange_t *exchange, const char *name, const char *value);
+
+/*
+ * Send the reply, once
+ *
+ * @param exchange: The request
+ * @param code: The HTTP status
+ * @param reason: The status text
+ * @param body: The body, drained, or NULL
+ */
+void server_send_reply(ServerExchange_t *exchange, int code, const char *reason, struct evbuffer *body);
+
+/*
+ * Run the server, every worker but the first in its own thread.
  * 
  * @param server: The server object
  */
@@ -0,0 +1,911 @@
+/*
+ * Geoclustering micro service 
+ * (c) Prince Cuberdon 2018
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its 
+ *    contributors may be used to endorse or promote products derived from 
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "server_uring.h"
+#include "log.h"
+
+#ifdef GEOCLUSTER_IO_URING
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256
+#define URING_BUFFERS 256
+#define URING_BUFFER_SIZE 4096
+#define URING_BUFFER_GROUP 0
+#define URING_HEAD_MAX 8192
+#define URING_HEADERS_MAX 32
+#define URING_IOV_MAX 64
+
+/* The operation is in the low bits of the user data, the connection in the others */
+#define URING_ACCEPT 1
+#define URING_RECV 2
+#define URING_SEND 3
+#define URING_OPERATION_MASK 3
+
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    /* The entries filled since the last submission */
+    unsigned tail;
+    unsigned pending;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} UringRing_t;
+
+typedef struct
+{
+    int fd;
+
+    /* The bytes received, the replies not sent yet, and those being sent */
+    struct evbuffer *input;
+    struct evbuffer *pending;
+    struct evbuffer *output;
+
+    int receiving;
+    int sending;
+    int closing;
+    int shut;
+    char remote_host[INET6_ADDRSTRLEN];
+    struct msghdr message;
+    struct iovec iov[URING_IOV_MAX];
+} UringConnection_t;
+
+typedef struct
+{
+    const char *name;
+    const char *value;
+} UringHeader_t;
+
+/* The request being served, the routes reply before returning */
+typedef struct
+{
+    ServerExchange_t exchange;
+    UringConnection_t *connection;
+    char head[URING_HEAD_MAX + 1];
+    char path[URING_HEAD_MAX + 1];
+    UringHeader_t headers[URING_HEADERS_MAX];
+    size_t headers_count;
+    struct evbuffer *reply_headers;
+    int is_head;
+    int keep_alive;
+    int replied;
+} UringRequest_t;
+
+typedef struct
+{
+    int fd;
+    struct sockaddr_storage peer;
+    socklen_t peer_length;
+} UringListener_t;
+
+typedef struct
+{
+    Server_t *server;
+    UringRing_t ring;
+
+    /* The TCP port and the Unix socket */
+    UringListener_t listeners[2];
+    size_t listeners_count;
+    struct io_uring_buf_ring *buffer_ring;
+    char *buffers;
+    unsigned short buffer_tail;
+    UringRequest_t request;
+    pthread_t thread;
+} UringWorker_t;
+
+static int ring_setup(UringRing_t *ring)
+{
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(UringRing_t));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0)
+    {
+        return 0;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_ring_size = ring->sq_ring_size > ring->cq_ring_size ? ring->sq_ring_size : ring->cq_ring_size;
+        ring->cq_ring_size = 0;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->cq_ring_size ? mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING)
+                                       : ring->sq_ring;
+    ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        log_critical("Unable to map the io_uring rings: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    ring->sq_head = (unsigned *) ((char *) ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *) ((char *) ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) ((char *) ring->sq_ring + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) ((char *) ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *) ((char *) ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ring + params.cq_off.cqes);
+    ring->tail = *ring->sq_tail;
+
+    return 1;
+}
+
+static void ring_dispose(UringRing_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring_size)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+/*
+ * Give the filled entries to the kernel, and wait for a completion
+ */
+static int ring_submit(UringRing_t *ring, int wait)
+{
+    int submitted;
+
+    __atomic_store_n(ring->sq_tail, ring->tail, __ATOMIC_RELEASE);
+    do
+    {
+        submitted = (int) syscall(__NR_io_uring_enter, ring->fd, ring->pending, wait ? 1 : 0,
+                                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted > 0)
+    {
+        ring->pending -= (unsigned) submitted;
+    }
+
+    return submitted;
+}
+
+static struct io_uring_sqe *ring_get_sqe(UringRing_t *ring)
+{
+    struct io_uring_sqe *sqe = NULL;
+    unsigned index;
+
+    /* Full, the kernel takes the entries right away */
+    if (ring->tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        ring_submit(ring, 0);
+    }
+
+    index = ring->tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->tail++;
+    ring->pending++;
+
+    return sqe;
+}
+
+/*
+ * Register the receive buffers, the kernel picks one when bytes arrive so the
+ * idle connections hold none
+ */
+static int buffers_setup(UringWorker_t *worker)
+{
+    struct io_uring_buf_reg reg;
+
+    worker->buffer_ring = (struct io_uring_buf_ring *) mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf),
+                                                            PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                                                            -1, 0);
+    worker->buffers = (char *) malloc((size_t) URING_BUFFERS * URING_BUFFER_SIZE);
+    if (worker->buffer_ring == MAP_FAILED || !worker->buffers)
+    {
+        log_critical("Unable to allocate the io_uring buffers");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) worker->buffer_ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, worker->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(worker->buffer_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+        free(worker->buffers);
+        return 0;
+    }
+
+    worker->buffer_tail = 0;
+    for (unsigned short i = 0; i < URING_BUFFERS; i++)
+    {
+        struct io_uring_buf *buf = &worker->buffer_ring->bufs[i];
+
+        buf->addr = (uint64_t) (uintptr_t) (worker->buffers + (size_t) i * URING_BUFFER_SIZE);
+        buf->len = URING_BUFFER_SIZE;
+        buf->bid = i;
+    }
+    worker->buffer_tail = URING_BUFFERS;
+    __atomic_store_n(&worker->buffer_ring->tail, worker->buffer_tail, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+static void buffers_recycle(UringWorker_t *worker, unsigned short bid)
+{
+    struct io_uring_buf *buf = &worker->buffer_ring->bufs[worker->buffer_tail & (URING_BUFFERS - 1)];
+
+    buf->addr = (uint64_t) (uintptr_t) (worker->buffers + (size_t) bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    worker->buffer_tail++;
+    __atomic_store_n(&worker->buffer_ring->tail, worker->buffer_tail, __ATOMIC_RELEASE);
+}
+
+static void buffers_dispose(UringWorker_t *worker)
+{
+    munmap(worker->buffer_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+    free(worker->buffers);
+}
+
+static void accept_connection(UringWorker_t *worker, UringListener_t *listener)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(&worker->ring);
+
+    listener->peer_length = sizeof(listener->peer);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener->fd;
+    sqe->addr = (uint64_t) (uintptr_t) &listener->peer;
+    sqe->addr2 = (uint64_t) (uintptr_t) &listener->peer_length;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t) (uintptr_t) listener | URING_ACCEPT;
+}
+
+static void connection_receive(UringWorker_t *worker, UringConnection_t *connection)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(&worker->ring);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->fd;
+    sqe->len = URING_BUFFER_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = (uint64_t) (uintptr_t) connection | URING_RECV;
+    connection->receiving = 1;
+}
+
+/*
+ * Send the replies, the buffer being sent is not touched until the kernel
+ * is done with it
+ */
+static void connection_send(UringWorker_t *worker, UringConnection_t *connection)
+{
+    struct io_uring_sqe *sqe = NULL;
+    int count;
+
+    if (!evbuffer_get_length(connection->output))
+    {
+        evbuffer_add_buffer(connection->output, connection->pending);
+    }
+
+    count = evbuffer_peek(connection->output, -1, NULL, connection->iov, URING_IOV_MAX);
+    count = count > URING_IOV_MAX ? URING_IOV_MAX : count;
+
+    memset(&connection->message, 0, sizeof(struct msghdr));
+    connection->message.msg_iov = connection->iov;
+    connection->message.msg_iovlen = (size_t) count;
+
+    sqe = ring_get_sqe(&worker->ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection->fd;
+    sqe->addr = (uint64_t) (uintptr_t) &connection->message;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t) (uintptr_t) connection | URING_SEND;
+    connection->sending = 1;
+}
+
+/*
+ * Free the connection once the kernel has nothing of it
+ */
+static void connection_release(UringConnection_t *connection)
+{
+    if (connection->receiving || connection->sending)
+    {
+        return;
+    }
+
+    close(connection->fd);
+    evbuffer_free(connection->input);
+    evbuffer_free(connection->pending);
+    evbuffer_free(connection->output);
+    free(connection);
+}
+
+/*
+ * The pending receive ends with the shutdown, then the connection is freed
+ */
+static void connection_close(UringConnection_t *connection)
+{
+    connection->closing = 1;
+    if (!connection->shut)
+    {
+        shutdown(connection->fd, SHUT_RDWR);
+        connection->shut = 1;
+    }
+    connection_release(connection);
+}
+
+static void connection_flush(UringWorker_t *worker, UringConnection_t *connection)
+{
+    if (connection->sending)
+    {
+        return;
+    }
+
+    if (evbuffer_get_length(connection->output) || evbuffer_get_length(connection->pending))
+    {
+        connection_send(worker, connection);
+    }
+    else if (connection->closing)
+    {
+        connection_close(connection);
+    }
+}
+
+/*
+ * Reply an error without calling a route, and close the connection after it
+ */
+static void connection_fail(UringConnection_t *connection, int code, const char *reason)
+{
+    evbuffer_add_printf(connection->pending, "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                        code, reason);
+    connection->closing = 1;
+}
+
+static const char *uring_find_header(ServerExchange_t *exchange, const char *name)
+{
+    UringRequest_t *request = (UringRequest_t *) exchange->transport;
+
+    for (size_t i = 0; i < request->headers_count; i++)
+    {
+        if (!strcasecmp(request->headers[i].name, name))
+        {
+            return request->headers[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+static void uring_add_header(ServerExchange_t *exchange, const char *name, const char *value)
+{
+    UringRequest_t *request = (UringRequest_t *) exchange->transport;
+
+    evbuffer_add_printf(request->reply_headers, "%s: %s\r\n", name, value);
+}
+
+static void uring_send_reply(ServerExchange_t *exchange, int code, const char *reason, struct evbuffer *body)
+{
+    UringRequest_t *request = (UringRequest_t *) exchange->transport;
+    struct evbuffer *pending = request->connection->pending;
+    size_t length = body ? evbuffer_get_length(body) : 0;
+    char date[64];
+    struct tm tm;
+    time_t now;
+
+    if (request->replied)
+    {
+        return;
+    }
+    request->replied = 1;
+
+    now = time(NULL);
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    evbuffer_add_printf(pending, "HTTP/1.1 %d %s\r\nDate: %s\r\n", code, reason, date);
+    if (code != 304 && code != 204)
+    {
+        evbuffer_add_printf(pending, "Content-Length: %zu\r\n", length);
+    }
+    if (!request->keep_alive)
+    {
+        evbuffer_add(pending, "Connection: close\r\n", 19);
+    }
+    evbuffer_add_buffer(pending, request->reply_headers);
+    evbuffer_add(pending, "\r\n", 2);
+
+    if (body && !request->is_head && code != 304 && code != 204)
+    {
+        evbuffer_add_buffer(pending, body);
+    }
+    else if (body)
+    {
+        evbuffer_drain(body, length);
+    }
+}
+
+/*
+ * Split the request line and the headers, in place
+ *
+ * @return 0 if it is not HTTP/1.x
+ */
+static int parse_request(UringRequest_t *request)
+{
+    char *line = request->head;
+    char *end = strstr(line, "\r\n");
+    char *method = line;
+    char *uri = NULL;
+    char *version = NULL;
+    char *query = NULL;
+
+    if (!end)
+    {
+        return 0;
+    }
+    *end = '\0';
+
+    uri = strchr(method, ' ');
+    version = uri ? strchr(uri + 1, ' ') : NULL;
+    if (!version)
+    {
+        return 0;
+    }
+    *uri++ = '\0';
+    *version++ = '\0';
+
+    if (strncmp(version, "HTTP/1.", 7) || (version[7] != '0' && version[7] != '1') || version[8])
+    {
+        return 0;
+    }
+    request->keep_alive = version[7] == '1';
+    request->is_head = !strcmp(method, "HEAD");
+    if (strcmp(method, "GET") && !request->is_head)
+    {
+        return 0;
+    }
+
+    request->exchange.uri = uri;
+    strcpy(request->path, uri);
+    query = strchr(request->path, '?');
+    if (query)
+    {
+        *query++ = '\0';
+    }
+    request->exchange.path = request->path;
+    request->exchange.query = query;
+
+    request->headers_count = 0;
+    for (line = end + 2; *line; line = end + 2)
+    {
+        char *colon = NULL;
+        char *value = NULL;
+        char *last = NULL;
+
+        end = strstr(line, "\r\n");
+        if (!end || end == line)
+        {
+            break;
+        }
+        *end = '\0';
+
+        colon = strchr(line, ':');
+        if (!colon || colon == line || request->headers_count == URING_HEADERS_MAX)
+        {
+            return 0;
+        }
+        *colon = '\0';
+
+        for (value = colon + 1; *value == ' ' || *value == '\t'; value++);
+        for (last = end; last > value && (last[-1] == ' ' || last[-1] == '\t'); last--);
+        *last = '\0';
+
+        request->headers[request->headers_count].name = line;
+        request->headers[request->headers_count].value = value;
+        request->headers_count++;
+    }
+
+    return 1;
+}
+
+static void serve_request(UringWorker_t *worker, UringConnection_t *connection, size_t length)
+{
+    UringRequest_t *request = &worker->request;
+    ServerExchange_t *exchange = &request->exchange;
+    const char *connection_header = NULL;
+    const char *content_length = NULL;
+
+    evbuffer_remove(connection->input, request->head, length);
+    request->head[length] = '\0';
+    request->connection = connection;
+    request->replied = 0;
+
+    exchange->remote_host = connection->remote_host;
+    exchange->request = NULL;
+    exchange->find_header = uring_find_header;
+    exchange->add_header = uring_add_header;
+    exchange->send_reply = uring_send_reply;
+    exchange->transport = request;
+
+    if (!parse_request(request))
+    {
+        connection_fail(connection, 400, "Bad Request");
+        return;
+    }
+
+    /* The routes only read, a body is not expected */
+    content_length = uring_find_header(exchange, "Content-Length");
+    if ((content_length && strcmp(content_length, "0")) || uring_find_header(exchange, "Transfer-Encoding"))
+    {
+        connection_fail(connection, 400, "Bad Request");
+        return;
+    }
+
+    connection_header = uring_find_header(exchange, "Connection");
+    if (connection_header)
+    {
+        if (!strcasecmp(connection_header, "close"))
+        {
+            request->keep_alive = 0;
+        }
+        else if (!strcasecmp(connection_header, "keep-alive"))
+        {
+            request->keep_alive = 1;
+        }
+    }
+
+    server_dispatch(worker->server, exchange);
+    if (!request->replied)
+    {
+        uring_send_reply(exchange, 500, "Internal Server Error", NULL);
+    }
+    evbuffer_drain(request->reply_headers, evbuffer_get_length(request->reply_headers));
+
+    if (!request->keep_alive)
+    {
+        connection->closing = 1;
+    }
+}
+
+/*
+ * Serve the complete requests received, pipelined ones included
+ */
+static void connection_process(UringWorker_t *worker, UringConnection_t *connection)
+{
+    while (!connection->closing)
+    {
+        struct evbuffer_ptr end = evbuffer_search(connection->input, "\r\n\r\n", 4, NULL);
+
+        if (end.pos < 0)
+        {
+            if (evbuffer_get_length(connection->input) > URING_HEAD_MAX)
+            {
+                connection_fail(connection, 431, "Request Header Fields Too Large");
+            }
+            return;
+        }
+
+        if ((size_t) end.pos + 4 > URING_HEAD_MAX)
+        {
+            connection_fail(connection, 431, "Request Header Fields Too Large");
+            return;
+        }
+
+        serve_request(worker, connection, (size_t) end.pos + 4);
+    }
+}
+
+static void on_accepted(UringWorker_t *worker, UringListener_t *listener, int fd)
+{
+    UringConnection_t *connection = NULL;
+    void *address = NULL;
+
+    accept_connection(worker, listener);
+    if (fd < 0)
+    {
+        log_warning("Unable to accept a connection: %s", strerror(-fd));
+        return;
+    }
+
+    connection = (UringConnection_t *) calloc(1, sizeof(UringConnection_t));
+    if (!connection)
+    {
+        log_critical("Unable to allocate a connection");
+        exit(EXIT_FAILURE);
+    }
+
+    connection->fd = fd;
+    connection->input = evbuffer_new();
+    connection->pending = evbuffer_new();
+    connection->output = evbuffer_new();
+
+    if (listener->peer.ss_family == AF_UNIX)
+    {
+        strcpy(connection->remote_host, "unix");
+    }
+    else
+    {
+        if (listener->peer.ss_family == AF_INET6)
+        {
+            address = &((struct sockaddr_in6 *) &listener->peer)->sin6_addr;
+        }
+        else
+        {
+            address = &((struct sockaddr_in *) &listener->peer)->sin_addr;
+        }
+        inet_ntop(listener->peer.ss_family, address, connection->remote_host, sizeof(connection->remote_host));
+    }
+
+    connection_receive(worker, connection);
+}
+
+static void on_received(UringWorker_t *worker, UringConnection_t *connection, int result, unsigned flags)
+{
+    connection->receiving = 0;
+
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = (unsigned short) (flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if (result > 0 && !connection->closing)
+        {
+            evbuffer_add(connection->input, worker->buffers + (size_t) bid * URING_BUFFER_SIZE, (size_t) result);
+        }
+        buffers_recycle(worker, bid);
+    }
+
+    if (result > 0 && !connection->closing)
+    {
+        connection_process(worker, connection);
+    }
+    else if (result != -ENOBUFS)
+    {
+        connection->closing = 1;
+    }
+
+    if (!connection->closing)
+    {
+        connection_receive(worker, connection);
+    }
+    connection_flush(worker, connection);
+}
+
+static void on_sent(UringWorker_t *worker, UringConnection_t *connection, int result)
+{
+    connection->sending = 0;
+
+    if (result < 0)
+    {
+        evbuffer_drain(connection->output, evbuffer_get_length(connection->output));
+        evbuffer_drain(connection->pending, evbuffer_get_length(connection->pending));
+        connection_close(connection);
+        return;
+    }
+
+    evbuffer_drain(connection->output, (size_t) result);
+    connection_flush(worker, connection);
+}
+
+static void *run_worker(void *data)
+{
+    UringWorker_t *worker = (UringWorker_t *) data;
+    UringRing_t *ring = &worker->ring;
+
+    for (size_t i = 0; i < worker->listeners_count; i++)
+    {
+        accept_connection(worker, &worker->listeners[i]);
+    }
+
+    while (ring_submit(ring, 1) >= 0)
+    {
+        unsigned head = *ring->cq_head;
+
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int result = cqe->res;
+            unsigned flags = cqe->flags;
+            void *target = (void *) (uintptr_t) (user_data & ~(uint64_t) URING_OPERATION_MASK);
+
+            __atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+
+            switch (user_data & URING_OPERATION_MASK)
+            {
+                case URING_ACCEPT:
+                    on_accepted(worker, (UringListener_t *) target, result);
+                    break;
+
+                case URING_RECV:
+                    on_received(worker, (UringConnection_t *) target, result, flags);
+                    break;
+
+                case URING_SEND:
+                    on_sent(worker, (UringConnection_t *) target, result);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    log_error("The io_uring loop stopped: %s", strerror(errno));
+
+    return NULL;
+}
+
+int server_uring_run(Server_t *server)
+{
+    UringWorker_t *workers = (UringWorker_t *) calloc(server->workers_count, sizeof(UringWorker_t));
+
+    if (!workers)
+    {
+        log_critical("Unable to allocate %zu io_uring workers", server->workers_count);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Every ring first, nothing is listening if the kernel refuses one */
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        if (!ring_setup(&workers[i].ring))
+        {
+            log_warning("Unable to setup io_uring: %s", strerror(errno));
+        }
+        else if (!buffers_setup(&workers[i]))
+        {
+            log_warning("Unable to register the io_uring buffers: %s", strerror(errno));
+            ring_dispose(&workers[i].ring);
+        }
+        else
+        {
+            continue;
+        }
+
+        while (i--)
+        {
+            buffers_dispose(&workers[i]);
+            ring_dispose(&workers[i].ring);
+        }
+        free(workers);
+        return 0;
+    }
+
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        workers[i].server = server;
+        workers[i].request.reply_headers = evbuffer_new();
+        workers[i].listeners_count = 0;
+        if (server->unix_socket >= 0)
+        {
+            workers[i].listeners[workers[i].listeners_count++].fd = dup(server->unix_socket);
+        }
+        if (server->socket >= 0 && server->tcp)
+        {
+            workers[i].listeners[workers[i].listeners_count++].fd = dup(server->socket);
+        }
+        else if (server->tcp)
+        {
+            workers[i].listeners[workers[i].listeners_count++].fd =
+                    server_listen(server->address, server->port, server->workers_count > 1);
+        }
+    }
+
+    if (server->tcp)
+    {
+        log_info("Listening on %s:%d with io_uring", server->address, server->port);
+    }
+    log_info("Serving with %zu workers", server->workers_count);
+
+    for (size_t i = 1; i < server->workers_count; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]))
+        {
+            log_critical("Unable to start the server worker %zu", i);
+            exit(EXIT_FAILURE);
+        }
+        affinity_pin(workers[i].thread, server->cpus, server->first_cpu + i);
+    }
+
+    affinity_pin(pthread_self(), server->cpus, server->first_cpu);
+    run_worker(&workers[0]);
+
+    for (size_t i = 1; i < server->workers_count; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < server->workers_count; i++)
+    {
+        for (size_t j = 0; j < workers[i].listeners_count; j++)
+        {
+            close(workers[i].listeners[j].fd);
+        }
+        evbuffer_free(workers[i].request.reply_headers);
+        buffers_dispose(&workers[i]);
+        ring_dispose(&workers[i].ring);
+    }
+    free(workers);
+
+    return 1;
+}
+
+#else
+
+int server_uring_run(Server_t *server)
+{
+    (void) server;
+    log_warning("Built without io_uring");
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "shared_store.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/*
+ * Point_t holds plain pointers, so the segment is mapped at the same address
+ * in every process. When the address is taken, the worker falls back to a
+ * private relocated copy.
+ */
+#define SHARED_BASE ((uintptr_t) 0x600000000000ULL)
+
+#define SHARED_MAGIC "GEOCLUST"
+#define SHARED_ATTACH_DELAY_US 100000
+/* The attempts between two logs while waiting, every 10 s */
+#define SHARED_ATTACH_LOG_EVERY 100
+
+static size_t page_round(size_t size)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+static PointArray_t *shared_store_view(SharedHeader_t *header)
+{
+    PointArray_t *points_array = points_array_create(ARRAY_EMPTY);
+
+    points_array->points = (Point_t **) ((char *) header + header->table_offset);
+    points_array->length = header->count;
+    points_array->position = (uint32_t) header->count;
+
+    return points_array;
+}
+
+PointArray_t *shared_store_publish(const char *name, PointArray_t *points_array, uint64_t regions,
+                                   uint64_t version)
+{
+    SharedHeader_t *header;
+    Point_t *records, **table;
+    char *base, *strings;
+    size_t count = points_array->position, strings_size = 0, size;
+    int fd;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (points_array->points[i]->desc)
+        {
+            strings_size += strlen(points_array->points[i]->desc) + 1;
+        }
+    }
+
+    size = page_round(sizeof(SharedHeader_t) + sizeof(Point_t) * count + sizeof(Point_t *) * count + strings_size);
+
+    if (shm_unlink(name) == -1 && errno != ENOENT)
+    {
+        log_warning("Unable to unlink the previous segment %s because: %s", name, strerror(errno));
+    }
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1 || ftruncate(fd, (off_t) size) == -1)
+    {
+        log_critical("Unable to create the shared segment %s because: %s", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    base = mmap((void *) SHARED_BASE, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (base != MAP_FAILED && base != (char *) SHARED_BASE)
+    {
+        munmap(base, size);
+        base = MAP_FAILED;
+    }
+    if (base == MAP_FAILED)
+    {
+        log_warning("The shared address %p is taken, workers will copy the points", (void *) SHARED_BASE);
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        log_critical("Unable to map the shared segment %s because: %s", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    header = (SharedHeader_t *) base;
+    records = (Point_t *) (base + sizeof(SharedHeader_t));
+    table = (Point_t **) (records + count);
+    strings = (char *) (table + count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        records[i] = *points_array->points[i];
+        if (records[i].desc)
+        {
+            size_t length = strlen(records[i].desc) + 1;
+
+            memcpy(strings, records[i].desc, length);
+            records[i].desc = strings;
+            strings += length;
+        }
+        table[i] = &records[i];
+    }
+
+    memcpy(header->magic, SHARED_MAGIC, sizeof(header->magic));
+    header->layout = SHARED_LAYOUT_VERSION;
+    header->version = version;
+    header->size = size;
+    header->base = (uint64_t) (uintptr_t) base;
+    header->count = count;
+    header->points_offset = sizeof(SharedHeader_t);
+    header->table_offset = (uint64_t) ((char *) table - base);
+    header->strings_offset = (uint64_t) ((char *) (table + count) - base);
+    header->point_size = sizeof(Point_t);
+    header->regions = regions;
+    __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+
+    mprotect(base, size, PROT_READ);
+    points_array_dispose(points_array);
+
+    log_info("Published %zu points (%zu bytes) in %s, version %llu", count, size, name,
+             (unsigned long long) header->version);
+
+    return shared_store_view(header);
+}
+
+/*
+ * Copy the segment in private memory and move its pointers to the copy
+ */
+static SharedHeader_t *shared_store_relocate(const SharedHeader_t *mapped)
+{
+    SharedHeader_t *copy = malloc(mapped->size);
+    Point_t **table;
+    intptr_t delta;
+
+    if (!copy)
+    {
+        log_critical("Memory error while copying the shared points");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(copy, mapped, mapped->size);
+    delta = (intptr_t) copy - (intptr_t) mapped->base;
+    table = (Point_t **) ((char *) copy + copy->table_offset);
+
+    for (size_t i = 0; i < copy->count; i++)
+    {
+        table[i] = (Point_t *) ((intptr_t) table[i] + delta);
+        if (table[i]->desc)
+        {
+            table[i]->desc = (char *) ((intptr_t) table[i]->desc + delta);
+        }
+    }
+
+    return copy;
+}
+
+static int shared_store_check(const SharedHeader_t *header, size_t size, uint64_t regions)
+{
+    if (size < sizeof(SharedHeader_t) || memcmp(header->magic, SHARED_MAGIC, sizeof(header->magic)) != 0)
+    {
+        log_critical("The shared segment isn't a geocluster dataset");
+        return 0;
+    }
+    if (header->layout != SHARED_LAYOUT_VERSION || header->point_size != sizeof(Point_t))
+    {
+        log_critical("The shared segment layout %u doesn't match this build (%u)",
+                     header->layout, SHARED_LAYOUT_VERSION);
+        return 0;
+    }
+    if (header->regions != regions)
+    {
+        log_critical("The shared segment was published with other regions, check the [regions] section");
+        return 0;
+    }
+    return 1;
+}
+
+PointArray_t *shared_store_attach(const char *name, uint64_t regions, unsigned int wait, uint64_t *version)
+{
+    SharedHeader_t *header = MAP_FAILED;
+    uint64_t attempts = (uint64_t) wait * 1000000 / SHARED_ATTACH_DELAY_US;
+    struct stat info;
+    int fd = -1;
+
+    for (uint64_t attempt = 0; !wait || attempt < attempts; attempt++)
+    {
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd != -1 && fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(SharedHeader_t))
+        {
+            header = mmap(NULL, sizeof(SharedHeader_t), PROT_READ, MAP_SHARED, fd, 0);
+            if (header != MAP_FAILED && __atomic_load_n(&header->ready, __ATOMIC_ACQUIRE))
+            {
+                break;
+            }
+            if (header != MAP_FAILED)
+            {
+                munmap(header, sizeof(SharedHeader_t));
+                header = MAP_FAILED;
+            }
+        }
+        if (fd != -1)
+        {
+            close(fd);
+            fd = -1;
+        }
+
+        if (attempt % SHARED_ATTACH_LOG_EVERY == 0)
+        {
+            log_info("Waiting for the shared segment %s", name);
+        }
+        usleep(SHARED_ATTACH_DELAY_US);
+    }
+
+    if (header == MAP_FAILED)
+    {
+        log_critical("Unable to attach the shared segment %s after %u s", name, wait);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!shared_store_check(header, (size_t) info.st_size, regions))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    {
+        void *wanted = (void *) (uintptr_t) header->base;
+        size_t size = header->size;
+
+        munmap(header, sizeof(SharedHeader_t));
+
+        header = mmap(wanted, size, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+        if (header != MAP_FAILED && header != wanted)
+        {
+            munmap(header, size);
+            header = MAP_FAILED;
+        }
+
+        if (header == MAP_FAILED)
+        {
+            SharedHeader_t *mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (mapped == MAP_FAILED)
+            {
+                log_critical("Unable to map the shared segment %s because: %s", name, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+
+            log_warning("The shared address %p is taken, use a private copy of the points", wanted);
+            header = shared_store_relocate(mapped);
+            munmap(mapped, size);
+        }
+    }
+    close(fd);
+
+    log_info("Attached %llu points from %s, version %llu", (unsigned long long) header->count, name,
+             (unsigned long long) header->version);
+
+    if (version)
+    {
+        *version = header->version;
+    }
+
+    return shared_store_view(header);
+}
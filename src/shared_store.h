@@ -0,0 +1,87 @@
+/*
+ * Geoclustering micro service
+ * (c) Prince Cuberdon 2018
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SHARED_STORE_H__
+#define __SHARED_STORE_H__
+
+#include "points_array.h"
+
+#include <stdint.h>
+
+/*
+ * Bump it whenever Point_t or the segment layout changes, so that workers
+ * built from another version refuse to attach.
+ */
+#define SHARED_LAYOUT_VERSION 4
+
+typedef struct SharedHeader_t
+{
+    char magic[8];
+    uint32_t layout;
+    uint32_t ready;
+    uint64_t version;
+    uint64_t size;
+    uint64_t base;
+    uint64_t count;
+    uint64_t points_offset;
+    uint64_t table_offset;
+    uint64_t strings_offset;
+    uint32_t point_size;
+    uint64_t regions;
+} SharedHeader_t;
+
+/*
+ * Copy the points into a POSIX shared memory segment. A previous segment with
+ * the same name is unlinked: attached workers keep it until they restart.
+ *
+ * The points are disposed, the returned array reads the segment.
+ *
+ * @param name: The segment name, like /geocluster
+ * @param points_array: The loaded points
+ * @param regions: The digest of the regions numbering the points, see region_digest
+ * @param version: The dataset version written in the header for the attached workers
+ * @return The points of the segment
+ */
+PointArray_t *shared_store_publish(const char *name, PointArray_t *points_array, uint64_t regions,
+                                   uint64_t version);
+
+/*
+ * Attach read-only to a segment made by shared_store_publish.
+ *
+ * @param name: The segment name
+ * @param regions: The digest of the regions of this process, it must match the publisher's
+ * @param wait: The seconds to wait for the publisher at most, 0 for ever
+ * @param version: Where to store the dataset version, or NULL
+ * @return The points of the segment
+ */
+PointArray_t *shared_store_attach(const char *name, uint64_t regions, unsigned int wait, uint64_t *version);
+
+#endif